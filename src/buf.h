@@ -29,4 +29,14 @@ static inline void riff_buf_add_char(riff_buf *b, char c) {
     riff_vec_add(b, c);
 }
 
+// Ensure room for at least `sz` more bytes
+static inline void riff_buf_reserve(riff_buf *b, size_t sz) {
+    if (riff_unlikely(b->cap - b->n < sz)) {
+        size_t cap = b->cap ? b->cap : VEC_INITIAL_CAP;
+        while (cap - b->n < sz)
+            cap *= VEC_GROWTH_FACTOR;
+        riff_buf_resize(b, cap);
+    }
+}
+
 #endif
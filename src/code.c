@@ -1,27 +1,52 @@
 #include "code.h"
 
+#include "conf.h"
 #include "mem.h"
 #include "string.h"
+#include "vm.h"
 
+#include <math.h>
 #include <stdio.h>
+#include <string.h>
 
 #define push(x) c_push(c, x)
 
 #define LAST_INS_IDX(arity) (c->n-(arity)-1)
 
-static void err(riff_code *c, const char *msg) {
+// Record the instruction just pushed as the last one, keeping track of the two
+// preceding it for the peephole optimizer
+#define set_last(arity)                   \
+    do {                                  \
+        c->prev[1] = c->prev[0];          \
+        c->prev[0] = c->last;             \
+        c->last    = LAST_INS_IDX(arity); \
+    } while (0)
+
+static void err(const char *msg) {
     fprintf(stderr, "riff: [compile] %s\n", msg);
     exit(1);
 }
 
+#include "ops.h"
+
 void c_init(riff_code *c) {
     c->code = NULL;
     c->k    = NULL;
+    c->gk   = NULL;
     c->last = 0;
     c->n    = 0;
     c->cap  = 0;
     c->nk   = 0;
     c->kcap = 0;
+    c->ngk  = 0;
+    c->prev[0] = -1;
+    c->prev[1] = -1;
+    c->label = 0;
+    c->kend  = -1;
+    riff_vec_init(&c->kpos);
+    riff_vec_init(&c->knk);
+    c->jit   = NULL;
+    c->hot   = 0;
 }
 
 void c_push(riff_code *c, uint8_t b) {
@@ -49,9 +74,127 @@ static void push_u16(riff_code *c, uint16_t i) {
 #endif
 }
 
+// Peephole optimization
+//
+// Common instruction sequences are fused into superinstructions as they are
+// emitted, so no jump offsets need adjusting afterward. A sequence is only
+// fused if no jump targets the middle of it.
+//
+// Binary operators whose right operand is a local variable or small integer
+// literal address it directly (e.g. ADDL x, ADDK n), and assignments to
+// variables store to them directly (STL x, STG x), instead of going through
+// the stack. Defining VM_STACK_ONLY (see conf.h) disables all of the above.
+
+#define OPCODE_ARITY(s,a) a,
+static const uint8_t arity[] = {
+    OPCODE_DEF(OPCODE_ARITY)
+};
+
+#define INS_END(i) ((i) + arity[c->code[(i)]] + 1)
+
+// Return the location of the first of the last n (up to 3) instructions if
+// they form a straight-line sequence ending at the current location, -1
+// otherwise
+static int peephole(riff_code *c, int n) {
+#ifdef VM_STACK_ONLY
+    return -1;
+#endif
+    int p[3] = {c->last, c->prev[0], c->prev[1]};
+    if (p[0] < 0 || p[0] >= c->n || INS_END(p[0]) != c->n)
+        return -1;
+    for (int i = 1; i < n; ++i) {
+        if (p[i] < 0 || p[i] >= p[i-1] || INS_END(p[i]) != p[i-1])
+            return -1;
+    }
+    return p[n-1] >= c->label ? p[n-1] : -1;
+}
+
+// Return the operand of the instruction at location i if it's one of the forms
+// of `op` (e.g. LCLV, LCLV0-2), -1 otherwise
+static int operand(riff_code *c, int i, int op) {
+    uint8_t b = c->code[i];
+    if (b == op)
+        return c->code[i+1];
+    else if (b > op && b <= op + 3)
+        return b - op - 1;
+    return -1;
+}
+
+// Replace the code from location i onward with superinstruction op
+static void fuse(riff_code *c, int i, int op, int x, int y) {
+    c->n = i;
+    push(op);
+    if (arity[op] > 0)
+        push((uint8_t) x);
+    if (arity[op] > 1)
+        push((uint8_t) y);
+    c->last = i;
+    c->prev[0] = c->prev[1] = -1;
+    c->kend = -1;
+}
+
+// Return the value of the instruction at location i if it pushes an integer
+// that fits in a byte, -1 otherwise
+static int imm_operand(riff_code *c, int i) {
+    switch (c->code[i]) {
+    case OP_ZERO: return 0;
+    case OP_ONE:  return 1;
+    case OP_IMM:  return c->code[i+1];
+    default:      return -1;
+    }
+}
+
+// Return the register/immediate (..L/..K) form of a binary operator, 0 if
+// there is none
+static int reg_op(int op) {
+    switch (op) {
+    case '+':            return OP_ADDL;
+    case '-':            return OP_SUBL;
+    case '*':            return OP_MULL;
+    case '/':            return OP_DIVL;
+    case '%':            return OP_MODL;
+    case '&':            return OP_ANDL;
+    case '|':            return OP_ORL;
+    case '^':            return OP_XORL;
+    case RIFF_TK_SHL:    return OP_SHLL;
+    case RIFF_TK_SHR:    return OP_SHRL;
+    case '#':            return OP_CATL;
+    case RIFF_TK_EQ:     return OP_EQL;
+    case RIFF_TK_NE:     return OP_NEL;
+    case '>':            return OP_GTL;
+    case RIFF_TK_GE:     return OP_GEL;
+    case '<':            return OP_LTL;
+    case RIFF_TK_LE:     return OP_LEL;
+    default:             return 0;
+    }
+}
+
 // Push a jump instruction and return the location of the byte to be
 // patched
 int c_prep_jump(riff_code *c, enum riff_code_jump type) {
+    // <cmp>; JZ16 => <cmp>JZ
+    int i = peephole(c, 1);
+    if (type == JZ && i >= 0 && c->code[i] >= OP_EQ && c->code[i] <= OP_LE) {
+        c->code[i] += OP_EQJZ - OP_EQ;
+        push(0x00);
+        push(0x00);
+        return c->n - 2;
+    }
+
+    // <cmp>L x; JZ16 => <cmp>LJZ x (likewise for ..K). The jump offset
+    // precedes the operand so it can be patched like any other.
+    if (type == JZ && i >= 0 && c->code[i] >= OP_EQL && c->code[i] <= OP_LEK) {
+        int op = c->code[i] - OP_EQL + OP_EQLJZ;
+        int x  = c->code[i+1];
+        c->n = i;
+        push(op);
+        push(0x00);
+        push(0x00);
+        push(x);
+        c->last = i;
+        c->prev[0] = c->prev[1] = -1;
+        return i + 1;
+    }
     switch (type) {
     case JMP:  push(OP_JMP16);  break;
     case JZ:   push(OP_JZ16);   break; 
@@ -79,7 +222,7 @@ int c_prep_loop(riff_code *c, int type) {
 
 void c_end_loop(riff_code *c) {
     push(OP_POPL);
-    c->last = LAST_INS_IDX(0);
+    set_last(0);
 }
 
 // Simple backward jumps. Encode a 2-byte offset if necessary.
@@ -95,7 +238,7 @@ void c_jump(riff_code *c, enum riff_code_jump type, int l) {
         default: break;
         }
         push((int8_t) d);
-        c->last = LAST_INS_IDX(1);
+        set_last(1);
     } else if (d <= INT16_MAX && d >= INT16_MIN) {
         switch (type) {
         case JMP:  push(OP_JMP16);  break;
@@ -106,9 +249,9 @@ void c_jump(riff_code *c, enum riff_code_jump type, int l) {
         default: break;
         }
         push_i16(c, (int16_t) d);
-        c->last = LAST_INS_IDX(2);
+        set_last(2);
     } else {
-        err(c, "backward jump larger than INT16_MAX");
+        err("backward jump larger than INT16_MAX");
     }
 }
 
@@ -117,13 +260,13 @@ void c_loop(riff_code *c, int l) {
     if (d <= UINT8_MAX) {
         push(OP_LOOP);
         push((uint8_t) d);
-        c->last = LAST_INS_IDX(1);
+        set_last(1);
     } else if (d <= UINT16_MAX) {
         push(OP_LOOP16);
         push_u16(c, (uint16_t) d);
-        c->last = LAST_INS_IDX(2);
+        set_last(2);
     } else {
-        err(c, "backward loop too large");
+        err("backward loop too large");
     }
 }
 
@@ -141,7 +284,7 @@ void c_range(riff_code *c, int from, int to, int step) {
             push(to ? OP_RNGT : OP_RNGI);
         }
     }
-    c->last = LAST_INS_IDX(0);
+    set_last(0);
 }
 
 // Overwrite the bytes at location l and l+1 with the distance between the code
@@ -149,7 +292,7 @@ void c_range(riff_code *c, int from, int to, int step) {
 void c_patch(riff_code *c, int l) {
     int jmp = c->n - l + 1;
     if (jmp > INT16_MAX) {
-        err(c, "forward jump too large to patch");
+        err("forward jump too large to patch");
     }
 #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
     c->code[l]   = (jmp & 0xff);
@@ -158,6 +301,12 @@ void c_patch(riff_code *c, int l) {
     c->code[l]   = ((jmp >> 8) & 0xff);
     c->code[l+1] = (jmp & 0xff);
 #endif
+    c->label = c->n;
+}
+
+// Mark the current location as the target of a backward jump and return it
+int c_label(riff_code *c) {
+    return c->label = c->n;
 }
 
 static void push_constant(riff_code *c, int i) {
@@ -166,12 +315,12 @@ static void push_constant(riff_code *c, int i) {
     case 1:
     case 2:
         push(OP_CONST0 + i);
-        c->last = LAST_INS_IDX(0);
+        set_last(0);
         break;
     default:
         push(OP_CONST);
         push((uint8_t) i);
-        c->last = LAST_INS_IDX(1);
+        set_last(1);
     }
 }
 
@@ -179,7 +328,7 @@ void c_fn_constant(riff_code *c, riff_fn *fn) {
     m_growarray(c->k, c->nk, c->kcap);
     c->k[c->nk++] = (riff_val) {TYPE_RFN, .fn = fn};
     if (c->nk > (UINT8_MAX + 1))
-        err(c, "Exceeded max number of unique literals");
+        err("Exceeded max number of unique literals");
     push_constant(c, c->nk - 1);
 }
 
@@ -191,7 +340,9 @@ static int find_constant(riff_code *c, riff_token *tk) {
                 return i;
             break;
         case RIFF_TK_FLOAT:
-            if (is_float(&c->k[i]) && tk->f == c->k[i].f)
+            // Keep -0.0 distinct from 0.0, which folding can produce
+            if (is_float(&c->k[i]) && tk->f == c->k[i].f &&
+                    signbit(tk->f) == signbit(c->k[i].f))
                 return i;
             break;
         case RIFF_TK_STR:
@@ -204,17 +355,34 @@ static int find_constant(riff_code *c, riff_token *tk) {
     return -1;
 }
 
+static void push_literal(riff_code *, riff_token *);
+
 // Add a riff_val literal to a code object's constant table, if necessary
 void c_constant(riff_code *c, riff_token *tk) {
+    int start = c->n, nk = c->nk;
+    push_literal(c, tk);
+    if (tk->kind == RIFF_TK_REGEX)
+        return;
+
+    // Record the push as part of the run of constants immediately preceding
+    // the current instruction for the folding routines below
+    if (c->kend != start)
+        c->kpos.n = c->knk.n = 0;
+    riff_vec_add(&c->kpos, start);
+    riff_vec_add(&c->knk, nk);
+    c->kend = c->n;
+}
+
+static void push_literal(riff_code *c, riff_token *tk) {
     if (tk->kind == RIFF_TK_NULL) {
         push(OP_NULL);
-        c->last = LAST_INS_IDX(0);
+        set_last(0);
         return;
     } else if (tk->kind == RIFF_TK_REGEX) {
         m_growarray(c->k, c->nk, c->kcap);
         c->k[c->nk++] = (riff_val) {TYPE_REGEX, .r = tk->r};
         if (c->nk > (UINT8_MAX + 1))
-            err(c, "Exceeded max number of unique literals");
+            err("Exceeded max number of unique literals");
         push_constant(c, c->nk - 1);
         return;
     }
@@ -237,18 +405,18 @@ void c_constant(riff_code *c, riff_token *tk) {
         case 0:
         case 1:
             push(OP_ZERO + i);
-            c->last = LAST_INS_IDX(0);
+            set_last(0);
             return;
         default:
             if (i >= 0 && i <= UINT8_MAX) {
                 push(OP_IMM);
                 push((uint8_t) i);
-                c->last = LAST_INS_IDX(1);
+                set_last(1);
                 return;
             } else if (i > UINT8_MAX && i <= UINT16_MAX) {
                 push(OP_IMM16);
                 push_u16(c, (uint16_t) i);
-                c->last = LAST_INS_IDX(2);
+                set_last(2);
                 return;
             } else {
                 m_growarray(c->k, c->nk, c->kcap);
@@ -267,7 +435,7 @@ void c_constant(riff_code *c, riff_token *tk) {
     }
 
     if (c->nk > (UINT8_MAX + 1))
-        err(c, "Exceeded max number of unique literals");
+        err("Exceeded max number of unique literals");
     push_constant(c, c->nk - 1);
 }
 
@@ -277,12 +445,12 @@ static void push_global_addr(riff_code *c, int i) {
     case 1:
     case 2:
         push(OP_GBLA0 + i);
-        c->last = LAST_INS_IDX(0);
+        set_last(0);
         break;
     default:
         push(OP_GBLA);
         push((uint8_t) i);
-        c->last = LAST_INS_IDX(1);
+        set_last(1);
     }
 }
 
@@ -292,15 +460,25 @@ static void push_global_val(riff_code *c, int i) {
     case 1:
     case 2:
         push(OP_GBLV0 + i);
-        c->last = LAST_INS_IDX(0);
+        set_last(0);
         break;
     default:
         push(OP_GBLV);
         push((uint8_t) i);
-        c->last = LAST_INS_IDX(1);
+        set_last(1);
     }
 }
 
+// Ensure the global cache has an (initially empty) entry for constant i. The
+// VM fills entries in on first access.
+static void reserve_global(riff_code *c, int i) {
+    if (i < c->ngk)
+        return;
+    c->gk = realloc(c->gk, (i + 1) * sizeof *c->gk);
+    while (c->ngk <= i)
+        c->gk[c->ngk++] = NULL;
+}
+
 // mode = 1 => VM will push the pointer to the riff_val in the global
 //             hash table onto the stack
 // mode = 0 => VM will make a copy of the global's riff_val and push it
@@ -310,6 +488,7 @@ void c_global(riff_code *c, riff_token *tk, int mode) {
     // Search for existing symbol
     for (int i = 0; i < c->nk; ++i) {
         if (is_str(&c->k[i]) && riff_str_eq(tk->s, c->k[i].s)) {
+            reserve_global(c, i);
             mode ? push_global_addr(c, i) : push_global_val(c, i);
             return;
         }
@@ -317,7 +496,8 @@ void c_global(riff_code *c, riff_token *tk, int mode) {
     m_growarray(c->k, c->nk, c->kcap);
     c->k[c->nk++] = (riff_val) {TYPE_STR, .s = tk->s};
     if (c->nk > (UINT8_MAX + 1))
-        err(c, "Exceeded max number of unique literals");
+        err("Exceeded max number of unique literals");
+    reserve_global(c, c->nk - 1);
     mode ? push_global_addr(c, c->nk - 1) : push_global_val(c, c->nk - 1);
 }
 
@@ -327,12 +507,12 @@ static void push_local_addr(riff_code *c, int i) {
     case 1:
     case 2:
         push(OP_LCLA0 + i);
-        c->last = LAST_INS_IDX(0);
+        set_last(0);
         break;
     default:
         push(OP_LCLA);
         push((uint8_t) i);
-        c->last = LAST_INS_IDX(1);
+        set_last(1);
     }
 }
 
@@ -342,12 +522,12 @@ static void push_local_val(riff_code *c, int i) {
     case 1:
     case 2:
         push(OP_LCLV0 + i);
-        c->last = LAST_INS_IDX(0);
+        set_last(0);
         break;
     default:
         push(OP_LCLV);
         push((uint8_t) i);
-        c->last = LAST_INS_IDX(1);
+        set_last(1);
     }
 }
 
@@ -358,7 +538,7 @@ void c_local(riff_code *c, int i, int mode, int reserve) {
     if (mode) {
         if (reserve) {
             push(OP_DUPA);
-            c->last = LAST_INS_IDX(0);
+            set_last(0);
         } else {
             push_local_addr(c, i);
         }
@@ -370,12 +550,12 @@ void c_local(riff_code *c, int i, int mode, int reserve) {
 void c_table(riff_code *c, int n) {
     if (!n) {
         push(OP_TAB0);
-        c->last = LAST_INS_IDX(0);
+        set_last(0);
         return;
     } else if (n <= 0xff) {
         push(OP_TAB);
         push((uint8_t) n);
-        c->last = LAST_INS_IDX(1);
+        set_last(1);
         return;
     } else {
         push(OP_TABK);
@@ -384,7 +564,7 @@ void c_table(riff_code *c, int n) {
         for (int i = 0; i < c->nk; ++i) {
             if (is_int(&c->k[i]) && c->k[i].i == n) {
                 push((uint8_t) i);
-                c->last = LAST_INS_IDX(1);
+                set_last(1);
                 return;
             }
         }
@@ -393,11 +573,11 @@ void c_table(riff_code *c, int n) {
         m_growarray(c->k, c->nk, c->kcap);
         c->k[c->nk++] = (riff_val) {TYPE_INT, .i = (riff_int) n};
         if (c->nk > (UINT8_MAX + 1)) {
-            err(c, "Exceeded max number of unique literals");
+            err("Exceeded max number of unique literals");
         }
         push((uint8_t) c->nk - 1);
     }
-    c->last = LAST_INS_IDX(1);
+    set_last(1);
 }
 
 static int is_addr(uint8_t opcode) {
@@ -455,20 +635,29 @@ void c_index(riff_code *c, int prev_idx, int n, int addr) {
     if (n == 1) {
         if (!is_addr(*prev)) {
             if (addr) {
-                err(c, "syntax error");
+                err("syntax error");
             }
             push(OP_VIDXV);
         } else {
+            // LCLA x; LCLV y; IDXV1 => IDXVLL x y
+            if (!addr && peephole(c, 2) == prev_idx) {
+                int x = operand(c, prev_idx, OP_LCLA);
+                int y = operand(c, c->last, OP_LCLV);
+                if (x >= 0 && y >= 0) {
+                    fuse(c, prev_idx, OP_IDXVLL, x, y);
+                    return;
+                }
+            }
             push(addr ? OP_IDXA1 : OP_IDXV1);
         }
-        c->last = LAST_INS_IDX(0);
+        set_last(0);
     } else {
         if (addr && !is_addr(*prev)) {
-            err(c, "syntax error");
+            err("syntax error");
         }
         push(addr ? OP_IDXA : OP_IDXV);
         push((uint8_t) n);
-        c->last = LAST_INS_IDX(1);
+        set_last(1);
     }
 }
 
@@ -476,36 +665,205 @@ void c_str_index(riff_code *c, int prev_idx, riff_str *k, int addr) {
     uint8_t *prev = &c->code[prev_idx];
     patch_val_to_addr(prev);
     if (!is_addr(*prev)) {
-        err(c, "invalid member access");
+        err("invalid member access");
     }
     int idx = find_constant(c, &(riff_token) {RIFF_TK_STR, .s = k});
     if (idx < 0) {
         m_growarray(c->k, c->nk, c->kcap);
         c->k[c->nk++] = (riff_val) {TYPE_STR, .s = k};
         if (c->nk > (UINT8_MAX + 1)) {
-            err(c, "Exceeded max number of unique literals");
+            err("Exceeded max number of unique literals");
         }
         idx = c->nk - 1;
     }
     push(addr ? OP_SIDXA : OP_SIDXV);
     push((uint8_t) idx);
-    c->last = LAST_INS_IDX(1);
+    set_last(1);
 }
 
 void c_fldv_index(riff_code *c, int mode) {
     push(mode ? OP_FLDA : OP_FLDV);
-    c->last = LAST_INS_IDX(0);
+    set_last(0);
 }
 
 void c_call(riff_code *c, int n) {
     push(OP_CALL);
     push((uint8_t) n);
-    c->last = LAST_INS_IDX(1);
+    set_last(1);
+}
+
+// Constant folding
+//
+// Every literal pushed by c_constant() is recorded in a run of constant pushes
+// ending at the current instruction. When an operator is applied to operands
+// at the end of the run, the operator is evaluated here (using the same
+// routines as the VM) and the operand pushes are replaced by a single push of
+// the result. Operands are never folded across a jump target.
+
+// Decode the value pushed by the constant instruction at location i
+static riff_val const_val(riff_code *c, int i) {
+    uint8_t *p = &c->code[i];
+    switch (*p) {
+    case OP_NULL:   return (riff_val) {TYPE_NULL};
+    case OP_ZERO:   return (riff_val) {TYPE_INT, .i = 0};
+    case OP_ONE:    return (riff_val) {TYPE_INT, .i = 1};
+    case OP_IMM:    return (riff_val) {TYPE_INT, .i = p[1]};
+    case OP_IMM16:  return (riff_val) {TYPE_INT, .i = *(uint16_t *) &p[1]};
+    case OP_CONST:  return c->k[p[1]];
+    default:        return c->k[*p - OP_CONST0];
+    }
+}
+
+// Return the location of the first of the last n constants if they make up the
+// current instruction stream's tail, -1 otherwise
+static int const_operands(riff_code *c, int n) {
+    if (c->kend != c->n || c->kpos.n < n)
+        return -1;
+    int start = RIFF_VEC_GET(&c->kpos, c->kpos.n - n);
+    return start >= c->label ? start : -1;
+}
+
+// Remove the constants added to the pool by the pushes in the run from index
+// i onward. Nothing else refers to them, since the pushes are the tail of the
+// instruction stream.
+static void drop_constants(riff_code *c, int i) {
+    c->nk = RIFF_VEC_GET(&c->knk, i);
+    if (c->ngk > c->nk)
+        c->ngk = c->nk;
+    c->kpos.n = c->knk.n = i;
+}
+
+// Replace the last n constant pushes with a push of v
+static void fold(riff_code *c, int n, riff_val *v) {
+    drop_constants(c, c->kpos.n - n);
+    c->n = c->kend = RIFF_VEC_GET(&c->kpos, c->kpos.n);
+    riff_token tk;
+    switch (v->type) {
+    case TYPE_INT:   tk = (riff_token) {RIFF_TK_INT, .i = v->i};   break;
+    case TYPE_FLOAT: tk = (riff_token) {RIFF_TK_FLOAT, .f = v->f}; break;
+    case TYPE_STR:
+        tk = (riff_token) {
+            RIFF_TK_STR,
+            .s = riff_str_new(riff_str_cstr(v->s), riff_strlen(v->s))
+        };
+        break;
+    default:         tk = (riff_token) {RIFF_TK_NULL};             break;
+    }
+    c_constant(c, &tk);
+}
+
+static int fold_infix(riff_code *c, int op) {
+    int start = const_operands(c, 2);
+    if (start < 0)
+        return 0;
+    riff_val l = const_val(c, start);
+    riff_val r = const_val(c, RIFF_VEC_GET(&c->kpos, c->kpos.n - 1));
+    switch (op) {
+    case '+':            riff_op_add(&l, &r); break;
+    case '-':            riff_op_sub(&l, &r); break;
+    case '*':            riff_op_mul(&l, &r); break;
+    case '/':            riff_op_div(&l, &r); break;
+    case '#':            riff_op_cat(&l, &r); break;
+    case '%':            riff_op_mod(&l, &r); break;
+    case '>':            riff_op_gt(&l, &r);  break;
+    case '<':            riff_op_lt(&l, &r);  break;
+    case '&':            riff_op_and(&l, &r); break;
+    case '|':            riff_op_or(&l, &r);  break;
+    case '^':            riff_op_xor(&l, &r); break;
+    case RIFF_TK_SHL:    riff_op_shl(&l, &r); break;
+    case RIFF_TK_SHR:    riff_op_shr(&l, &r); break;
+    case RIFF_TK_POW:    riff_op_pow(&l, &r); break;
+    case RIFF_TK_GE:     riff_op_ge(&l, &r);  break;
+    case RIFF_TK_LE:     riff_op_le(&l, &r);  break;
+    case RIFF_TK_EQ:     riff_op_eq(&l, &r);  break;
+    case RIFF_TK_NE:     riff_op_ne(&l, &r);  break;
+    default: return 0;
+    }
+    fold(c, 2, &l);
+    return 1;
+}
+
+static int fold_prefix(riff_code *c, int op) {
+    int start = const_operands(c, 1);
+    if (start < 0)
+        return 0;
+    riff_val v = const_val(c, start);
+    switch (op) {
+    case '!': riff_op_lnot(&v); break;
+    case '#': riff_op_len(&v);  break;
+    case '+': riff_op_num(&v);  break;
+    case '-': riff_op_neg(&v);  break;
+    case '~': riff_op_not(&v);  break;
+    default: return 0;
+    }
+    fold(c, 1, &v);
+    return 1;
+}
+
+static int fold_concat(riff_code *c, int n) {
+    int start = const_operands(c, n);
+    if (start < 0)
+        return 0;
+    riff_val v = const_val(c, start);
+    for (int i = c->kpos.n - n + 1; i < c->kpos.n; ++i) {
+        riff_val r = const_val(c, RIFF_VEC_GET(&c->kpos, i));
+        riff_op_cat(&v, &r);
+    }
+    fold(c, n, &v);
+    return 1;
+}
+
+// If the last instruction pushes a constant, remove it and return its logical
+// value (0/1). Returns -1 otherwise. Used to eliminate dead branches.
+int c_fold_test(riff_code *c) {
+    int start = const_operands(c, 1);
+    if (start < 0)
+        return -1;
+    riff_val v = const_val(c, start);
+    drop_constants(c, c->kpos.n - 1);
+    c->n = start;
+    c->kpos.n = c->knk.n = 0;
+    c->kend = -1;
+    return riff_op_test(&v);
+}
+
+// Drop any code emitted past location n
+void c_discard(riff_code *c, int n) {
+    c->n = n;
+    c->prev[0] = c->prev[1] = -1;
+    c->label = n;
+    c->kpos.n = c->knk.n = 0;
+    c->kend = -1;
 }
 
-// TODO this function will be used to evaluate infix expression "nodes" and fold
-// constants if possible.
 void c_infix(riff_code *c, int op) {
+    if (fold_infix(c, op))
+        return;
+
+    // LCLV x; LCLV y; ADD => ADDLL x y
+    int i = peephole(c, 2);
+    if (op == '+' && i >= 0) {
+        int x = operand(c, i, OP_LCLV);
+        int y = operand(c, c->last, OP_LCLV);
+        if (x >= 0 && y >= 0) {
+            fuse(c, i, OP_ADDLL, x, y);
+            return;
+        }
+    }
+
+    // LCLV x; <op> => <op>L x
+    // ZERO|ONE|IMM x; <op> => <op>K x
+    int r = reg_op(op);
+    if (r && (i = peephole(c, 1)) >= 0) {
+        int x;
+        if ((x = operand(c, i, OP_LCLV)) >= 0) {
+            fuse(c, i, r, x, 0);
+            return;
+        } else if ((x = imm_operand(c, i)) >= 0) {
+            fuse(c, i, r + 1, x, 0);
+            return;
+        }
+    }
     switch (op) {
     case '+':            push(OP_ADD);    break;
     case '-':            push(OP_SUB);    break;
@@ -542,10 +900,38 @@ void c_infix(riff_code *c, int op) {
     case RIFF_TK_SHRX:   push(OP_SHRX);   break;
     default: break;
     }
-    c->last = LAST_INS_IDX(0);
+    set_last(0);
+}
+
+// Compile `=` given the locations of the instruction pushing the LHS address
+// and the start of the RHS. Simple assignments to variables drop the address
+// push, moving the RHS code down in its place, and store to the variable
+// directly.
+void c_assign(riff_code *c, int lhs, int rhs) {
+    int op = -1, x = -1;
+#ifndef VM_STACK_ONLY
+    if (lhs >= 0 && lhs < rhs && INS_END(lhs) == rhs && c->label != rhs) {
+        if ((x = operand(c, lhs, OP_LCLA)) >= 0)
+            op = OP_STL;
+        else if ((x = operand(c, lhs, OP_GBLA)) >= 0)
+            op = OP_STG;
+    }
+#endif
+    if (op < 0) {
+        c_infix(c, '=');
+        return;
+    }
+    int d = rhs - lhs;
+    memmove(&c->code[lhs], &c->code[rhs], c->n - rhs);
+    c->n -= d;
+    if (c->label > rhs)
+        c->label -= d;
+    fuse(c, c->n, op, x, 0);
 }
 
 void c_prefix(riff_code *c, int op) {
+    if (fold_prefix(c, op))
+        return;
     switch (op) {
     case '!':         push(OP_LNOT);   break;
     case '#':         push(OP_LEN);    break;
@@ -556,7 +942,7 @@ void c_prefix(riff_code *c, int op) {
     case RIFF_TK_DEC: push(OP_PREDEC); break;
     default: break;
     }
-    c->last = LAST_INS_IDX(0);
+    set_last(0);
 }
 
 void c_postfix(riff_code *c, int op) {
@@ -565,38 +951,84 @@ void c_postfix(riff_code *c, int op) {
     case RIFF_TK_DEC: push(OP_POSTDEC); break;
     default: break;
     }
-    c->last = LAST_INS_IDX(0);
+    set_last(0);
 }
 
 void c_concat(riff_code *c, int n) {
+    if (n >= 2 && fold_concat(c, n))
+        return;
     if (n == 2) {
         push(OP_CAT);
-        c->last = LAST_INS_IDX(0);
+        set_last(0);
     } else if (n > 2) {
         push(OP_CATI);
         push((uint8_t) n);
-        c->last = LAST_INS_IDX(1);
+        set_last(1);
     }
 }
 
 void c_pop(riff_code *c, int n) {
     if (n == 1) {
         push(OP_POP);
-        c->last = LAST_INS_IDX(0);
+        set_last(0);
     } else if (n > 1) {
         push(OP_POPI);
         push((uint8_t) n);
-        c->last = LAST_INS_IDX(1);
+        set_last(1);
+    }
+}
+
+// Fuse ++/--/+= expression statements on variables. Returns 1 if successful.
+static int fuse_stmt(riff_code *c) {
+    int i, x, y;
+    switch (c->code[c->last]) {
+
+    // LCLA x; PREINC|POSTINC; POP => INCL x (likewise for globals, --)
+    case OP_PREINC:
+    case OP_POSTINC:
+    case OP_PREDEC:
+    case OP_POSTDEC: {
+        if ((i = peephole(c, 2)) < 0)
+            return 0;
+        int dec = c->code[c->last] == OP_PREDEC || c->code[c->last] == OP_POSTDEC;
+        if ((x = operand(c, i, OP_LCLA)) >= 0)
+            fuse(c, i, dec ? OP_DECL : OP_INCL, x, 0);
+        else if ((x = operand(c, i, OP_GBLA)) >= 0)
+            fuse(c, i, dec ? OP_DECG : OP_INCG, x, 0);
+        else
+            return 0;
+        return 1;
+    }
+
+    // LCLA x; LCLV y; ADDX; POP => ADDXLL x y
+    case OP_ADDX:
+        if ((i = peephole(c, 3)) < 0)
+            return 0;
+        x = operand(c, i, OP_LCLA);
+        y = operand(c, c->prev[0], OP_LCLV);
+        if (x < 0 || y < 0)
+            return 0;
+        fuse(c, i, OP_ADDXLL, x, y);
+        return 1;
+    default:
+        return 0;
     }
 }
 
 void c_pop_expr_stmt(riff_code *c, int n) {
-    if (n == 1 && c->code[c->n-1] == OP_SET) {
-        c->code[c->n-1] = OP_SETP;
-        c->last = LAST_INS_IDX(0);
-    } else {
-        c_pop(c, n);
+    int i = c->last;
+    if (n == 1 && i >= 0 && i < c->n && INS_END(i) == c->n) {
+        switch (c->code[i]) {
+        case OP_SET: c->code[i] = OP_SETP; return;
+        case OP_STL: c->code[i] = OP_STLP; return;
+        case OP_STG: c->code[i] = OP_STGP; return;
+        default:
+            if (fuse_stmt(c))
+                return;
+            break;
+        }
     }
+    c_pop(c, n);
 }
 
 // t = 0 => void return
@@ -613,5 +1045,5 @@ void c_return(riff_code *c, int t) {
         }
         push(OP_RET1);
     }
-    c->last = LAST_INS_IDX(0);
+    set_last(0);
 }
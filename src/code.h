@@ -2,6 +2,7 @@
 #define CODE_H
 
 #include "lex.h"
+#include "util.h"
 #include "value.h"
 
 #include <stdint.h>
@@ -106,6 +107,75 @@
     _(SRNGI,   0)                               \
     _(SET,     0)                               \
     _(SETP,    0)                               \
+    _(INCL,    1)  _(DECL,    1)                \
+    _(INCG,    1)  _(DECG,    1)                \
+    _(ADDLL,   2)                               \
+    _(ADDXLL,  2)                               \
+    _(IDXVLL,  2)                               \
+    _(EQJZ,    2)  _(NEJZ,    2)                \
+    _(GTJZ,    2)  _(GEJZ,    2)                \
+    _(LTJZ,    2)  _(LEJZ,    2)                \
+    _(ADDL,    1)  _(ADDK,    1)                \
+    _(SUBL,    1)  _(SUBK,    1)                \
+    _(MULL,    1)  _(MULK,    1)                \
+    _(DIVL,    1)  _(DIVK,    1)                \
+    _(MODL,    1)  _(MODK,    1)                \
+    _(ANDL,    1)  _(ANDK,    1)                \
+    _(ORL,     1)  _(ORK,     1)                \
+    _(XORL,    1)  _(XORK,    1)                \
+    _(SHLL,    1)  _(SHLK,    1)                \
+    _(SHRL,    1)  _(SHRK,    1)                \
+    _(CATL,    1)  _(CATK,    1)                \
+    _(EQL,     1)  _(EQK,     1)                \
+    _(NEL,     1)  _(NEK,     1)                \
+    _(GTL,     1)  _(GTK,     1)                \
+    _(GEL,     1)  _(GEK,     1)                \
+    _(LTL,     1)  _(LTK,     1)                \
+    _(LEL,     1)  _(LEK,     1)                \
+    _(EQLJZ,   3)  _(EQKJZ,   3)                \
+    _(NELJZ,   3)  _(NEKJZ,   3)                \
+    _(GTLJZ,   3)  _(GTKJZ,   3)                \
+    _(GELJZ,   3)  _(GEKJZ,   3)                \
+    _(LTLJZ,   3)  _(LTKJZ,   3)                \
+    _(LELJZ,   3)  _(LEKJZ,   3)                \
+    _(STL,     1)  _(STLP,    1)                \
+    _(STG,     1)  _(STGP,    1)                \
+    _(IADD,    0)  _(FADD,    0)                \
+    _(ISUB,    0)  _(FSUB,    0)                \
+    _(IMUL,    0)  _(FMUL,    0)                \
+    _(IEQ,     0)  _(FEQ,     0)                \
+    _(INE,     0)  _(FNE,     0)                \
+    _(IGT,     0)  _(FGT,     0)                \
+    _(IGE,     0)  _(FGE,     0)                \
+    _(ILT,     0)  _(FLT,     0)                \
+    _(ILE,     0)  _(FLE,     0)                \
+    _(IEQJZ,   2)  _(FEQJZ,   2)                \
+    _(INEJZ,   2)  _(FNEJZ,   2)                \
+    _(IGTJZ,   2)  _(FGTJZ,   2)                \
+    _(IGEJZ,   2)  _(FGEJZ,   2)                \
+    _(ILTJZ,   2)  _(FLTJZ,   2)                \
+    _(ILEJZ,   2)  _(FLEJZ,   2)                \
+    _(IADDL,   1)  _(FADDL,   1)                \
+    _(ISUBL,   1)  _(FSUBL,   1)                \
+    _(IMULL,   1)  _(FMULL,   1)                \
+    _(IEQLJZ,  3)  _(FEQLJZ,  3)                \
+    _(INELJZ,  3)  _(FNELJZ,  3)                \
+    _(IGTLJZ,  3)  _(FGTLJZ,  3)                \
+    _(IGELJZ,  3)  _(FGELJZ,  3)                \
+    _(ILTLJZ,  3)  _(FLTLJZ,  3)                \
+    _(ILELJZ,  3)  _(FLELJZ,  3)                \
+
+// Instructions with integer (I..) and float (F..) variants, which they're
+// rewritten into at runtime (see vm.c)
+#define QUICKEN_DEF(_)                          \
+    _(ADD)    _(SUB)    _(MUL)                  \
+    _(EQ)     _(NE)     _(GT)                   \
+    _(GE)     _(LT)     _(LE)                   \
+    _(EQJZ)   _(NEJZ)   _(GTJZ)                 \
+    _(GEJZ)   _(LTJZ)   _(LEJZ)                 \
+    _(ADDL)   _(SUBL)   _(MULL)                 \
+    _(EQLJZ)  _(NELJZ)  _(GTLJZ)                \
+    _(GELJZ)  _(LTLJZ)  _(LELJZ)                \
 
 #define OPCODE_ENUM(s,a)  OP_##s,
 enum riff_opcode {
@@ -123,11 +193,20 @@ enum riff_code_jump {
 typedef struct {
     uint8_t  *code;  // Bytecode array
     riff_val *k;     // Constants pool
+    riff_val **gk;   // Resolved global addresses, parallel to k
     int       last;  // Index of the last opcode pushed
+    int       prev[2]; // Indices of the two opcodes preceding last
     int       n;     // Number of bytes in bytecode array
     int       cap;   // Bytecode array capacity
     int       nk;    // Number of constants in pool
     int       kcap;  // Constants pool capacity
+    int       ngk;   // Number of entries in gk
+    int       label; // Location of the most recent jump target
+    int       kend;  // End of the trailing run of constant pushes
+    RIFF_VEC(int) kpos; // Locations of the constant pushes in the run
+    RIFF_VEC(int) knk;  // Size of the constants pool before each push in kpos
+    struct riff_jit *jit; // Native code (see jit.h)
+    int       hot;   // Calls and backward jumps executed before compiling
 } riff_code;
 
 void c_init(riff_code *);
@@ -143,12 +222,16 @@ void c_fldv_index(riff_code *, int);
 void c_call(riff_code *c, int);
 void c_prefix(riff_code *, int);
 void c_infix(riff_code *, int);
+void c_assign(riff_code *, int, int);
 void c_postfix(riff_code *, int);
 void c_concat(riff_code *, int);
 void c_jump(riff_code *, enum riff_code_jump, int);
 void c_loop(riff_code *, int);
 void c_range(riff_code *, int, int, int);
 void c_patch(riff_code *, int);
+int  c_label(riff_code *);
+int  c_fold_test(riff_code *);
+void c_discard(riff_code *, int);
 int  c_prep_jump(riff_code *, enum riff_code_jump);
 int  c_prep_loop(riff_code *, int);
 void c_end_loop(riff_code *);
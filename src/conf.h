@@ -4,14 +4,69 @@
 // Default precision for floating point numbers in fmt()
 #define DEFAULT_FLT_PREC 6
 
-// Output format for floats (implicit/explicit print)
-#define FLT_PRINT_FMT "%.14g"
+// Number of significant digits in the output of floats (implicit/explicit
+// print), as with "%.14g"
+#define FLT_PRINT_PREC 14
 
-// Size of buffer used in l_char() and l_fmt()
+// Size of stack buffers used for short strings (e.g. l_char(), captures);
+// longer results spill to the heap
 #define STR_BUF_SZ 0x1000
 
+// Minimum capacity of the buffers backing strings built with `#=`
+#define STR_BUF_MIN_CAP 0x20
+
+// Initial and maximum sizes of the stack used by JIT-compiled regular
+// expressions. Matching typical log lines rarely needs more than the initial
+// size; deeply backtracking patterns grow it up to the maximum.
+#define RE_JIT_STACK_MIN 0x8000
+#define RE_JIT_STACK_MAX 0x100000
+
+// Number of regexes compiled from strings at runtime (e.g. `s ~ "a+"`) kept
+// in the LRU cache
+#define RE_CACHE_SIZE 16
+
+// Minimum length of a literal substring required by a regex for subjects to
+// be searched for it before running the full match
+#define RE_LIT_MIN 2
+
+// Minimum size of a regular file for reads to be served from a memory mapping
+// of the file instead of read(2)
+#define MMAP_MIN_SIZE 0x100000
+
+// Size of the buffer collecting output to stdout (print(), printf(), etc.)
+#define OUT_BUF_SZ 0x10000
+
 // Size of VM stack
 // Currently statically allocated
 #define VM_STACK_SIZE 0x1000
 
+// Define to compile plain stack code, without the superinstructions and
+// register operands emitted by the peephole optimizer (e.g. for comparison)
+// #define VM_STACK_ONLY
+
+// Define to count the instructions dispatched by the VM (not including native
+// code run with -j), printing the total to stderr on exit
+// #define VM_COUNT_INSNS
+
+// Number of calls and backward jumps after which a code object is compiled to
+// native code when the JIT is enabled (-j)
+#define JIT_HOT_COUNT 1000
+
+// Bytes allocated before the first garbage collection cycle starts, and the
+// minimum allowance between cycles
+#define GC_MIN_HEAP 0x400000
+
+// Bytes allowed to be allocated between cycles, as a percentage of the data
+// found reachable by the previous cycle
+#define GC_PAUSE 100
+
+// Bytes allocated between incremental collector steps
+#define GC_STEP_SIZE 0x4000
+
+// Amount of work performed per collector step, in bytes traversed/swept
+#define GC_STEP_WORK 0x10000
+
+// Work charged for sweeping a single object
+#define GC_SWEEP_COST 0x40
+
 #endif
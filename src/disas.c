@@ -34,13 +34,15 @@ OPCODE_DEF(MNEMONIC_ENUM)
 #define INST1       F_XX "   " F_LMNEMONIC F_OPERAND          "\n"
 #define INST1DEREF  F_XX "   " F_LMNEMONIC F_LOPERAND F_DEREF "\n"
 #define INST2       F_XX F_XX  F_LMNEMONIC F_OPERAND          "\n"
+#define INST11      F_XX F_XX  F_LMNEMONIC F_OPERAND " " F_OPERAND "\n"
+#define INST21      F_XX F_XX F_XX F_LMNEMONIC F_OPERAND " " F_OPERAND "\n"
 
 // Wrap string in quotes
 // TODO deconstruct bytes that correspond to escape sequences into their literal
 //      forms
 static size_t disas_tostr(riff_val *v, char **out) {
     if (is_str(v))
-        return (size_t) sprintf(*out, "'%s'", v->s->str);
+        return (size_t) sprintf(*out, "'%s'", riff_str_cstr(v->s));
     return riff_tostr(v, out);
 }
 
@@ -64,6 +66,10 @@ static void disas_code(riff_code *c, const int ip_width) {
             case OP_GBLV:
             case OP_SIDXA:
             case OP_SIDXV:
+            case OP_INCG:
+            case OP_DECG:
+            case OP_STG:
+            case OP_STGP:
                 riff_tostr(&c->k[b[1]], &sptr);
                 printf(INST1DEREF, b[1], MNEMONIC(b[0]), b[1], sptr);
                 break;
@@ -81,6 +87,12 @@ static void disas_code(riff_code *c, const int ip_width) {
             case OP_XJNZ16:
             case OP_ITERV:
             case OP_ITERKV:
+            case OP_EQJZ:
+            case OP_NEJZ:
+            case OP_GTJZ:
+            case OP_GEJZ:
+            case OP_LTJZ:
+            case OP_LEJZ:
                 printf(INST2, b[1], b[2], MNEMONIC(b[0]), ip + *(int16_t *) &b[1]);
                 break;
             case OP_LOOP:
@@ -92,6 +104,26 @@ static void disas_code(riff_code *c, const int ip_width) {
             case OP_IMM16:
                 printf(INST2, b[1], b[2], MNEMONIC(b[0]), *(uint16_t *) &b[1]);
                 break;
+            case OP_ADDLL:
+            case OP_ADDXLL:
+            case OP_IDXVLL:
+                printf(INST11, b[1], b[2], MNEMONIC(b[0]), b[1], b[2]);
+                break;
+            case OP_EQLJZ:
+            case OP_EQKJZ:
+            case OP_NELJZ:
+            case OP_NEKJZ:
+            case OP_GTLJZ:
+            case OP_GTKJZ:
+            case OP_GELJZ:
+            case OP_GEKJZ:
+            case OP_LTLJZ:
+            case OP_LTKJZ:
+            case OP_LELJZ:
+            case OP_LEKJZ:
+                printf(INST21, b[1], b[2], b[3], MNEMONIC(b[0]),
+                       ip + *(int16_t *) &b[1], b[3]);
+                break;
             default:
                 printf(INST1, b[1], MNEMONIC(b[0]), b[1]);
                 break;
@@ -1,6 +1,7 @@
 #include "fmt.h"
 
 #include "conf.h"
+#include "string.h"
 
 #include <ctype.h>
 #include <stdint.h>
@@ -17,59 +18,72 @@ static void err(const char *msg) {
 #define FMT_SPACE 4
 #define FMT_LEFT  8
 
+// Append formatted output to buffer `b`, growing it if needed. Arguments may
+// be evaluated twice.
+#define fmt_sprintf(b, ...) \
+    do { \
+        size_t avail_ = (b)->cap - (b)->n; \
+        int m_ = snprintf((b)->list + (b)->n, avail_, __VA_ARGS__); \
+        if ((size_t) m_ >= avail_) { \
+            riff_buf_reserve(b, m_ + 1); \
+            snprintf((b)->list + (b)->n, m_ + 1, __VA_ARGS__); \
+        } \
+        (b)->n += m_; \
+    } while (0)
+
 // %c (if c <= 0x7f)
-#define fmt_char(b, n, c) \
+#define fmt_char(b, c) \
     if (flags & FMT_LEFT) { \
-        n += sprintf(b + n, "%-*c", width, c); \
+        fmt_sprintf(b, "%-*c", width, c); \
     } else { \
-        n += sprintf(b + n, "%*c", width, c); \
+        fmt_sprintf(b, "%*c", width, c); \
     }
 
 // %s
-#define fmt_str(b, n, s) \
+#define fmt_str(b, s) \
     if (flags & FMT_LEFT) { \
-        n += sprintf(b + n, "%-*.*s", width, prec, s); \
+        fmt_sprintf(b, "%-*.*s", width, prec, s); \
     } else { \
-        n += sprintf(b + n, "%*.*s", width, prec, s); \
+        fmt_sprintf(b, "%*.*s", width, prec, s); \
     }
 
 // Signed fmt conversions: floats, decimal integers
-#define fmt_signed(b, n, i, fmt) \
+#define fmt_signed(b, i, fmt) \
     if (flags & FMT_LEFT) { \
         if (flags & FMT_SIGN) { \
-            n += sprintf(b + n, "%-+*.*"fmt, width, prec, i); \
+            fmt_sprintf(b, "%-+*.*"fmt, width, prec, i); \
         } else if (flags & FMT_SPACE) { \
-            n += sprintf(b + n, "%- *.*"fmt, width, prec, i); \
+            fmt_sprintf(b, "%- *.*"fmt, width, prec, i); \
         } else { \
-            n += sprintf(b + n, "%-*.*"fmt, width, prec, i); \
+            fmt_sprintf(b, "%-*.*"fmt, width, prec, i); \
         } \
     } else if ((prec < 0) && (flags & FMT_ZERO)) { \
         if (flags & FMT_SIGN) { \
-            n += sprintf(b + n, "%+0*"fmt, width, i); \
+            fmt_sprintf(b, "%+0*"fmt, width, i); \
         } else if (flags & FMT_SPACE) { \
-            n += sprintf(b + n, "% 0*"fmt, width, i); \
+            fmt_sprintf(b, "% 0*"fmt, width, i); \
         } else { \
-            n += sprintf(b + n, "%0*"fmt, width, i); \
+            fmt_sprintf(b, "%0*"fmt, width, i); \
         } \
     } else if (flags & FMT_SIGN) { \
-        n += sprintf(b + n, "%+*.*"fmt, width, prec, i); \
+        fmt_sprintf(b, "%+*.*"fmt, width, prec, i); \
     } else if (flags & FMT_SPACE) { \
-        n += sprintf(b + n, "% *.*"fmt, width, prec, i); \
+        fmt_sprintf(b, "% *.*"fmt, width, prec, i); \
     } else { \
-        n += sprintf(b + n, "%*.*"fmt, width, prec, i); \
+        fmt_sprintf(b, "%*.*"fmt, width, prec, i); \
     }
 
 // Unsigned fmt conversions: hex and octal integers
 // Only difference is absence of space flag, since numbers are
 // converted to unsigned anyway. clang also throws a warning
 // about UB for octal/hex conversions with the space flag.
-#define fmt_unsigned(b, n, i, fmt) \
+#define fmt_unsigned(b, i, fmt) \
     if (flags & FMT_LEFT) { \
-        n += sprintf(b + n, "%-*.*"fmt, width, prec, i); \
+        fmt_sprintf(b, "%-*.*"fmt, width, prec, i); \
     } else if ((prec < 0) && (flags & FMT_ZERO)) { \
-        n += sprintf(b + n, "%0*"fmt, width, i); \
+        fmt_sprintf(b, "%0*"fmt, width, i); \
     } else { \
-        n += sprintf(b + n, "%*.*"fmt, width, prec, i); \
+        fmt_sprintf(b, "%*.*"fmt, width, prec, i); \
     }
 
 // %b
@@ -127,19 +141,22 @@ static int fmt_bin_itoa(char *buf, riff_int num, uint32_t flags, int width, int
 //   o              | Octal integer
 //   s              | String
 //   x / X          | Hex integer (lowercase/uppercase)
-int fmt_snprintf(char *buf, size_t bufsz, const char *fstr, riff_val *argv, int argc) {
+//
+// Output is appended to `buf`, which is left NUL-terminated. Returns the
+// number of bytes appended.
+size_t fmt_bprintf(riff_buf *buf, const char *fstr, riff_val *argv, int argc) {
     int arg = 0;
-    int n   = 0;
+    size_t start = buf->n;
 
-    while (*fstr && argc && n <= bufsz) {
+    while (*fstr && argc) {
         if (*fstr != '%') {
-            buf[n++] = *fstr++;
+            riff_buf_add_char(buf, *fstr++);
             continue;
         }
 
         // Advance pointer and check for literal '%'
         if (*++fstr == '%') {
-            buf[n++] = '%';
+            riff_buf_add_char(buf, '%');
             ++fstr;
             continue;
         }
@@ -202,7 +219,7 @@ capture_flags:
             if (argc--) {
                 uint32_t c = (uint32_t) intval(argv+arg);
                 if (c <= 0x7f) {
-                    fmt_char(buf, n, c);
+                    fmt_char(buf, c);
                 } else {
                     int n1 = 0;
                     char ubuf[8];
@@ -212,7 +229,7 @@ capture_flags:
                         tbuf[n1++] = ubuf[j];
                     }
                     tbuf[n1] = '\0';
-                    fmt_str(buf, n, tbuf);
+                    fmt_str(buf, tbuf);
                 }
                 ++arg;
             }
@@ -238,7 +255,7 @@ capture_flags:
                     n1 = j + 1;
                 }
                 mbuf[n1] = '\0';
-                fmt_str(buf, n, mbuf);
+                fmt_str(buf, mbuf);
                 ++arg;
             }
             break;
@@ -247,7 +264,12 @@ capture_flags:
             if (argc--) {
 redir_int:
                 i = intval(argv+arg);
-                fmt_signed(buf, n, i, PRId64);
+                if (!flags && width < 0 && prec < 0) {
+                    riff_buf_reserve(buf, 32);
+                    buf->n += riff_lltostr(i, buf->list + buf->n);
+                } else {
+                    fmt_signed(buf, i, PRId64);
+                }
                 ++arg;
             }
             break;
@@ -255,27 +277,28 @@ redir_int:
         case 'o':
             if (argc--) {
                 i = intval(argv+arg);
-                fmt_unsigned(buf, n, i, PRIo64);
+                fmt_unsigned(buf, i, PRIo64);
                 ++arg;
             }
             break;
         case 'x':
             if (argc--) {
                 i = intval(argv+arg);
-                fmt_unsigned(buf, n, i, PRIx64);
+                fmt_unsigned(buf, i, PRIx64);
                 ++arg;
             }
             break;
         case 'X':
             if (argc--) {
                 i = intval(argv+arg);
-                fmt_unsigned(buf, n, i, PRIX64);
+                fmt_unsigned(buf, i, PRIX64);
                 ++arg;
             }
             break;
         case 'b':
             if (argc--) {
-                n += fmt_bin_itoa(buf + n, intval(argv+arg), flags, width, prec);
+                riff_buf_reserve(buf, width > 64 ? width : 64);
+                buf->n += fmt_bin_itoa(buf->list + buf->n, intval(argv+arg), flags, width, prec);
                 ++arg;
             }
             break;
@@ -283,7 +306,7 @@ redir_int:
             if (argc--) {
                 f = fltval(argv+arg);
                 // Default precision left as -1 for `a`
-                fmt_signed(buf, n, f, "a");
+                fmt_signed(buf, f, "a");
                 ++arg;
             }
             break;
@@ -291,7 +314,7 @@ redir_int:
             if (argc--) {
                 f = fltval(argv+arg);
                 // Default precision left as -1 for `A`
-                fmt_signed(buf, n, f, "A");
+                fmt_signed(buf, f, "A");
                 ++arg;
             }
             break;
@@ -299,7 +322,7 @@ redir_int:
             if (argc--) {
                 f = fltval(argv+arg);
                 prec = prec < 0 ? DEFAULT_FLT_PREC : prec;
-                fmt_signed(buf, n, f, "e");
+                fmt_signed(buf, f, "e");
                 ++arg;
             }
             break;
@@ -307,7 +330,7 @@ redir_int:
             if (argc--) {
                 f = fltval(argv+arg);
                 prec = prec < 0 ? DEFAULT_FLT_PREC : prec;
-                fmt_signed(buf, n, f, "E");
+                fmt_signed(buf, f, "E");
                 ++arg;
             }
             break;
@@ -315,7 +338,7 @@ redir_int:
             if (argc--) {
                 f = fltval(argv+arg);
                 prec = prec < 0 ? DEFAULT_FLT_PREC : prec;
-                fmt_signed(buf, n, f, "f");
+                fmt_signed(buf, f, "f");
                 ++arg;
             }
             break;
@@ -324,7 +347,12 @@ redir_int:
 redir_flt:
                 f = fltval(argv+arg);
                 prec = prec < 0 ? DEFAULT_FLT_PREC : prec;
-                fmt_signed(buf, n, f, "g");
+                if (!flags && width < 0 && prec <= 17) {
+                    riff_buf_reserve(buf, 32);
+                    buf->n += riff_gtostr(f, prec, buf->list + buf->n);
+                } else {
+                    fmt_signed(buf, f, "g");
+                }
                 ++arg;
             }
             break;
@@ -332,7 +360,7 @@ redir_flt:
             if (argc--) {
                 f = fltval(argv+arg);
                 prec = prec < 0 ? DEFAULT_FLT_PREC : prec;
-                fmt_signed(buf, n, f, "G");
+                fmt_signed(buf, f, "G");
                 ++arg;
             }
             break;
@@ -341,7 +369,7 @@ redir_flt:
         case 's':
             if (argc--) {
                 if (is_str(argv+arg)) {
-                    fmt_str(buf, n, argv[arg].s->str);
+                    fmt_str(buf, riff_str_cstr(argv[arg].s));
                 } else if (is_int(argv+arg)) {
                     goto redir_int;
                 } else if (is_float(argv+arg)) {
@@ -350,7 +378,7 @@ redir_flt:
 
                 // TODO handle other types
                 else {
-                    fmt_str(buf, n, "");
+                    fmt_str(buf, "");
                 }
                 ++arg;
             }
@@ -359,15 +387,14 @@ redir_flt:
             // Throw error
             err("invalid format specifier");
         }
-
-        if (n >= bufsz)
-            err("string length exceeds maximum buffer size");
     }
 
     // Copy rest of string after exhausting user-provided args
-    while (*fstr && n <= bufsz) {
-        buf[n++] = *fstr++;
+    while (*fstr) {
+        riff_buf_add_char(buf, *fstr++);
     }
 
-    return n;
+    riff_buf_reserve(buf, 1);
+    buf->list[buf->n] = '\0';
+    return buf->n - start;
 }
@@ -1,8 +1,9 @@
 #ifndef FMT_H
 #define FMT_H
 
+#include "buf.h"
 #include "value.h"
 
-int fmt_snprintf(char *, size_t, const char *, riff_val *, int);
+size_t fmt_bprintf(riff_buf *, const char *, riff_val *, int);
 
 #endif
@@ -3,5 +3,6 @@
 void riff_fn_init(riff_fn *f) {
     f->name  = NULL;
     f->arity = 0;
+    f->gcepoch = 0;
     c_init(&f->code);
 }
@@ -8,6 +8,7 @@ struct riff_fn {
     riff_code  code;
     uint8_t    arity;
     riff_str  *name;
+    uint32_t   gcepoch;
 };
 
 void riff_fn_init(riff_fn *);
@@ -0,0 +1,201 @@
+#include "gc.h"
+
+#include "conf.h"
+#include "fn.h"
+#include "mem.h"
+#include "string.h"
+#include "vm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+ptrdiff_t riff_gc_debt  = -GC_MIN_HEAP;
+uint8_t   riff_gc_state = GC_STATE_PAUSE;
+
+static riff_gc_obj  *objects   = NULL; // All collectable objects
+static riff_gc_obj  *sweeplist = NULL; // Objects pending sweep
+static riff_tab     *gray      = NULL; // Tables pending traversal
+static riff_tab     *grayagain = NULL; // Tables modified while black
+static uint32_t      epoch     = 0;    // Current cycle; marks functions
+static size_t        estimate  = 0;    // Bytes reachable in current cycle
+
+void *riff_gc_new(size_t sz, uint8_t type) {
+    riff_gc_obj *o = malloc(sz);
+    o->type = type;
+    // Objects created mid-propagation are considered reachable for the
+    // remainder of the cycle
+    o->mark = riff_gc_state == GC_STATE_PROPAGATE ? GC_BLACK : GC_WHITE;
+    o->next = objects;
+    objects = o;
+    riff_gc_account(sz);
+    return o;
+}
+
+void riff_gc_barrier_back(riff_tab *t) {
+    if (riff_gc_state != GC_STATE_PROPAGATE)
+        return;
+    t->gc.mark = GC_GRAY;
+    t->gclist = grayagain;
+    grayagain = t;
+}
+
+void riff_gc_mark_str(riff_str *s) {
+    if (!s->mark) {
+        s->mark = 1;
+        estimate += sizeof(riff_str) + riff_strlen(s) + 1;
+        if (riff_str_view(s))
+            riff_str_buf(s)->mark = 1;
+    }
+}
+
+void riff_gc_mark_tab(riff_tab *t) {
+    if (t->gc.type != GC_OBJ_STATIC && t->gc.mark == GC_WHITE) {
+        t->gc.mark = GC_GRAY;
+        t->gclist = gray;
+        gray = t;
+    }
+}
+
+static void mark_fn(riff_fn *fn) {
+    if (fn->gcepoch == epoch)
+        return;
+    fn->gcepoch = epoch;
+    for (int i = 0; i < fn->code.nk; ++i)
+        riff_gc_mark_val(&fn->code.k[i]);
+}
+
+static inline void mark_obj(riff_gc_obj *o) {
+    if (o->type != GC_OBJ_STATIC && o->mark == GC_WHITE) {
+        o->mark = GC_BLACK;
+        estimate += o->type == GC_OBJ_RANGE ? sizeof(riff_range) : sizeof(riff_file);
+    }
+}
+
+void riff_gc_mark_val(riff_val *v) {
+    switch (v->type) {
+    case TYPE_STR:   riff_gc_mark_str(v->s);  break;
+    case TYPE_FILE:  mark_obj(&v->fh->gc);    break;
+    case TYPE_RANGE: mark_obj(&v->q->gc);     break;
+    case TYPE_TAB:   riff_gc_mark_tab(v->t);  break;
+    case TYPE_RFN:   mark_fn(v->fn);          break;
+    default: break;
+    }
+}
+
+// Traverse tables from the gray list until the work budget is spent. Returns
+// the amount of work performed.
+static size_t propagate(size_t budget) {
+    size_t work = 0;
+    while (gray && work < budget) {
+        riff_tab *t = gray;
+        gray = t->gclist;
+        t->gc.mark = GC_BLACK;
+        size_t n = riff_tab_traverse(t);
+        estimate += n;
+        work += n;
+    }
+    return work;
+}
+
+static void mark_roots(void) {
+    riff_vm_mark_roots();
+}
+
+// Finish marking in one go: re-mark the roots and re-traverse every table
+// modified since it was blackened.
+static void atomic(void) {
+    mark_roots();
+    while (grayagain) {
+        riff_tab *t = grayagain;
+        grayagain = t->gclist;
+        t->gc.mark = GC_GRAY;
+        t->gclist = gray;
+        gray = t;
+    }
+    propagate(SIZE_MAX);
+    riff_stab_sweep_begin();
+    sweeplist = objects;
+    objects = NULL;
+    riff_gc_state = GC_STATE_SWEEP;
+}
+
+static void free_obj(riff_gc_obj *o) {
+    switch (o->type) {
+    case GC_OBJ_TAB:
+        riff_tab_free((riff_tab *) o);
+        break;
+    case GC_OBJ_FILE: {
+        riff_file *f = (riff_file *) o;
+        if (!(f->flags & (FH_STD | FH_CLOSED)))
+            fclose(f->p);
+        if (f->flags & FH_MMAP)
+            munmap(f->rbuf, f->rcap);
+        else
+            free(f->rbuf);
+        free(f);
+        break;
+    }
+    default:
+        free(o);
+        break;
+    }
+}
+
+// Sweep a bounded number of objects, relinking survivors (reset to white) into
+// the list of live objects.
+static size_t sweep(size_t budget) {
+    size_t work = 0;
+    while (sweeplist && work < budget) {
+        riff_gc_obj *o = sweeplist;
+        sweeplist = o->next;
+        if (o->mark == GC_WHITE) {
+            free_obj(o);
+        } else {
+            o->mark = GC_WHITE;
+            o->next = objects;
+            objects = o;
+        }
+        work += GC_SWEEP_COST;
+    }
+    return work;
+}
+
+void riff_gc_step(void) {
+    size_t work = 0;
+    while (work < GC_STEP_WORK) {
+        switch (riff_gc_state) {
+        case GC_STATE_PAUSE:
+            ++epoch;
+            estimate = 0;
+            mark_roots();
+            riff_gc_state = GC_STATE_PROPAGATE;
+            break;
+        case GC_STATE_PROPAGATE:
+            if (gray) {
+                work += propagate(GC_STEP_WORK - work);
+            } else {
+                atomic();
+                work += GC_SWEEP_COST;
+            }
+            break;
+        case GC_STATE_SWEEP: {
+            size_t n = riff_stab_sweep(GC_STEP_WORK - work);
+            if (n) {
+                work += n;
+            } else if (sweeplist) {
+                work += sweep(GC_STEP_WORK - work);
+            } else {
+                // Cycle complete; wait for the heap to grow by GC_PAUSE
+                // percent of the reachable data before starting the next one
+                size_t t = estimate / 100 * GC_PAUSE;
+                riff_gc_debt = -(ptrdiff_t) (t < GC_MIN_HEAP ? GC_MIN_HEAP : t);
+                riff_gc_state = GC_STATE_PAUSE;
+                return;
+            }
+            break;
+        }
+        }
+    }
+    riff_gc_debt = -GC_STEP_SIZE;
+}
@@ -0,0 +1,66 @@
+#ifndef GC_H
+#define GC_H
+
+#include "table.h"
+#include "util.h"
+#include "value.h"
+
+#include <stddef.h>
+
+// Incremental tri-color mark & sweep collector.
+//
+// Collectable objects (tables, ranges, files) carry a riff_gc_obj header and
+// are linked into a single list of all objects. Strings are owned by the
+// string table and carry their own mark bit; the string table is swept
+// incrementally once marking completes. Functions are never freed, but marking
+// one marks its code constants.
+//
+// The VM drives the collector through safe points (function entry and
+// backward jumps). Objects are only ever freed at a safe point, so C code
+// (library functions, the compiler) can allocate freely between them without
+// registering temporaries as roots.
+
+enum riff_gc_obj_types {
+    GC_OBJ_STATIC,  // Not managed by the collector (e.g. stdin, argv)
+    GC_OBJ_TAB,
+    GC_OBJ_RANGE,
+    GC_OBJ_FILE,
+};
+
+enum riff_gc_colors {
+    GC_WHITE,
+    GC_GRAY,
+    GC_BLACK,
+};
+
+enum riff_gc_states {
+    GC_STATE_PAUSE,
+    GC_STATE_PROPAGATE,
+    GC_STATE_SWEEP,
+};
+
+// Bytes allocated past the current threshold. The collector performs a unit
+// of work at the next safe point whenever this is positive.
+extern ptrdiff_t riff_gc_debt;
+extern uint8_t   riff_gc_state;
+
+#define riff_gc_account(n) (riff_gc_debt += (ptrdiff_t) (n))
+
+// Backward barrier: a black table receiving a new reference is turned gray
+// again and re-traversed in the atomic phase.
+#define riff_gc_barrier(t) \
+    if (riff_unlikely((t)->gc.mark == GC_BLACK)) riff_gc_barrier_back(t)
+
+// Forward barrier: a value stored through an address whose owner is unknown is
+// marked outright while the collector is marking.
+#define riff_gc_barrier_fwd(v) \
+    if (riff_unlikely(riff_gc_state == GC_STATE_PROPAGATE)) riff_gc_mark_val(v)
+
+void *riff_gc_new(size_t, uint8_t);
+void  riff_gc_barrier_back(riff_tab *);
+void  riff_gc_step(void);
+void  riff_gc_mark_val(riff_val *);
+void  riff_gc_mark_str(riff_str *);
+void  riff_gc_mark_tab(riff_tab *);
+
+#endif
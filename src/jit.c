@@ -0,0 +1,448 @@
+#include "jit.h"
+
+int riff_jit_enabled = 0;
+
+#ifdef RIFF_JIT
+
+#include "conf.h"
+#include "util.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define OPCODE_ARITY(s,a) a,
+static const uint8_t arity[] = {
+    OPCODE_DEF(OPCODE_ARITY)
+};
+
+// x86-64 registers
+enum {
+    RAX = 0,
+    RCX = 1,
+    RDX = 2,
+    RBX = 3,
+    R12 = 12,
+    R13 = 13,
+};
+
+// Register assignment for native code. R13 holds the address SP is stored to
+// on exit.
+#define SP RBX
+#define FP R12
+
+// Condition codes (Jcc/SETcc). A condition is negated by flipping bit 0.
+enum {
+    CC_E  = 0x4,
+    CC_NE = 0x5,
+    CC_L  = 0xc,
+    CC_GE = 0xd,
+    CC_LE = 0xe,
+    CC_G  = 0xf,
+};
+
+// Operand forms of binary instructions
+enum {
+    OPND_STACK, // sp[-1] (left operand at sp[-2])
+    OPND_LOCAL, // fp[x]  (left operand at sp[-1])
+    OPND_IMM,   // x      (left operand at sp[-1])
+};
+
+// Displacements of slot x relative to SP/FP and of its fields
+#define SLOT(x)   ((int) ((x) * (int) sizeof(vm_stack)))
+#define TYPEOF(x) (SLOT(x) + (int) offsetof(riff_val, type))
+#define INTOF(x)  (SLOT(x) + (int) offsetof(riff_val, i))
+
+typedef struct {
+    int at;   // Location of the rel32 operand
+    int loc;  // Target bytecode location
+    int exit; // Jump to the exit stub for loc rather than its code
+} jit_fixup;
+
+typedef struct {
+    RIFF_VEC(uint8_t)   b;    // Native code
+    RIFF_VEC(jit_fixup) f;    // Pending jumps
+    int                *pos;  // Native offset of each instruction
+    int                 exit; // Native offset of the common exit sequence
+} jit_buf;
+
+#define EMIT(...) \
+    emit(j, (uint8_t []) {__VA_ARGS__}, sizeof ((uint8_t []) {__VA_ARGS__}))
+
+static void emit(jit_buf *j, const uint8_t *p, size_t n) {
+    for (size_t i = 0; i < n; ++i)
+        riff_vec_add(&j->b, p[i]);
+}
+
+static void emit32(jit_buf *j, int32_t x) {
+    EMIT(x, x >> 8, x >> 16, x >> 24);
+}
+
+static void emit_op(jit_buf *j, int w, int op, int reg, int rm) {
+    int rex = 0x40 | w << 3 | (reg >> 3) << 2 | rm >> 3;
+    if (rex != 0x40)
+        EMIT(rex);
+    if (op > 0xff)
+        EMIT(op >> 8);
+    EMIT(op);
+}
+
+// Instruction with a memory operand [base+disp]. `reg` is a register or an
+// opcode extension.
+static void op_mem(jit_buf *j, int w, int op, int reg, int base, int disp) {
+    emit_op(j, w, op, reg, base);
+    int disp8 = disp >= -128 && disp <= 127;
+    EMIT((disp8 ? 0x40 : 0x80) | (reg & 7) << 3 | (base & 7));
+    if ((base & 7) == 4)
+        EMIT(0x24); // SIB for RSP/R12 base
+    if (disp8)
+        EMIT(disp);
+    else
+        emit32(j, disp);
+}
+
+// Register-register instruction
+static void op_reg(jit_buf *j, int w, int op, int reg, int rm) {
+    emit_op(j, w, op, reg, rm);
+    EMIT(0xc0 | (reg & 7) << 3 | (rm & 7));
+}
+
+// Jump to bytecode location loc, or to its exit stub. cc < 0 for an
+// unconditional jump.
+static void jump(jit_buf *j, int cc, int loc, int exit) {
+    if (cc < 0)
+        EMIT(0xe9);
+    else
+        EMIT(0x0f, 0x80 | cc);
+    riff_vec_add(&j->f, ((jit_fixup) {(int) j->b.n, loc, exit}));
+    emit32(j, 0);
+}
+
+// Exit to the interpreter at loc
+static void exit_to(jit_buf *j, int loc) {
+    EMIT(0xb8);
+    emit32(j, loc);                              // mov eax, loc
+    EMIT(0xe9);
+    emit32(j, j->exit - ((int) j->b.n + 4));     // jmp exit
+}
+
+static void add_sp(jit_buf *j, int n) {
+    op_reg(j, 1, 0x83, n < 0 ? 5 : 0, SP);      // add/sub rbx, imm8
+    EMIT(abs(SLOT(n)));
+}
+
+// Exit at loc unless base[x] holds an integer
+static void guard_int(jit_buf *j, int base, int x, int loc) {
+    op_mem(j, 0, 0x80, 7, base, TYPEOF(x));     // cmp byte [base+x], TYPE_INT
+    EMIT(TYPE_INT);
+    jump(j, CC_NE, loc, 1);
+}
+
+static void copy_slot(jit_buf *j, int dbase, int dx, int sbase, int sx) {
+    for (int i = 0; i < (int) sizeof(vm_stack); i += 8) {
+        op_mem(j, 1, 0x8b, RAX, sbase, SLOT(sx) + i);
+        op_mem(j, 1, 0x89, RAX, dbase, SLOT(dx) + i);
+    }
+}
+
+// Push a value of type t with integer value x
+static void push_imm(jit_buf *j, int t, int x) {
+    op_mem(j, 1, 0xc7, 0, SP, SLOT(0));         // mov qword [rbx], t
+    emit32(j, t);
+    if (t == TYPE_INT) {
+        op_mem(j, 1, 0xc7, 0, SP, INTOF(0));    // mov qword [rbx+8], x
+        emit32(j, x);
+    }
+    add_sp(j, 1);
+}
+
+// Load the integer operands of a binary instruction into RAX (left) and RCX
+// (right), exiting at loc if either isn't an integer. Returns the slot of the
+// left operand relative to SP.
+static int int_operands(jit_buf *j, int loc, int form, int x) {
+    int l = form == OPND_STACK ? -2 : -1;
+    guard_int(j, SP, l, loc);
+    switch (form) {
+    case OPND_STACK:
+        guard_int(j, SP, -1, loc);
+        op_mem(j, 1, 0x8b, RCX, SP, INTOF(-1));
+        break;
+    case OPND_LOCAL:
+        guard_int(j, FP, x, loc);
+        op_mem(j, 1, 0x8b, RCX, FP, INTOF(x));
+        break;
+    case OPND_IMM:
+        EMIT(0xb9);
+        emit32(j, x);                           // mov ecx, x
+        break;
+    }
+    op_mem(j, 1, 0x8b, RAX, SP, INTOF(l));
+    return l;
+}
+
+// <op> rax, rcx; store result to the left operand
+static void arith(jit_buf *j, int loc, int form, int x, int op) {
+    int l = int_operands(j, loc, form, x);
+    op_reg(j, 1, op, RAX, RCX);
+    op_mem(j, 1, 0x89, RAX, SP, INTOF(l));
+    if (form == OPND_STACK)
+        add_sp(j, -1);
+}
+
+// cmp rax, rcx; store boolean result to the left operand
+static void compare(jit_buf *j, int loc, int form, int x, int cc) {
+    int l = int_operands(j, loc, form, x);
+    op_reg(j, 1, 0x3b, RAX, RCX);
+    EMIT(0x0f, 0x90 | cc, 0xc0);                // setcc al
+    EMIT(0x0f, 0xb6, 0xc0);                     // movzx eax, al
+    op_mem(j, 1, 0x89, RAX, SP, INTOF(l));
+    if (form == OPND_STACK)
+        add_sp(j, -1);
+}
+
+// Compare and pop both operands, jumping to target if false
+static void compare_jump(jit_buf *j, int loc, int form, int x, int cc, int target) {
+    int l = int_operands(j, loc, form, x);
+    add_sp(j, l);
+    op_reg(j, 1, 0x3b, RAX, RCX);
+    jump(j, cc ^ 1, target, 0);
+}
+
+// Pop an integer and jump to target if it's zero (cc = CC_E) or non-zero
+// (cc = CC_NE)
+static void test_jump(jit_buf *j, int loc, int cc, int target) {
+    guard_int(j, SP, -1, loc);
+    op_mem(j, 1, 0x8b, RAX, SP, INTOF(-1));
+    add_sp(j, -1);
+    op_reg(j, 1, 0x85, RAX, RAX);               // test rax, rax
+    jump(j, cc, target, 0);
+}
+
+// x86 opcode (r64, r/m64 form) for arithmetic instructions
+static int arith_op(int op) {
+    switch (op) {
+    case OP_ADD: case OP_ADDL: case OP_ADDK: return 0x03;
+    case OP_SUB: case OP_SUBL: case OP_SUBK: return 0x2b;
+    case OP_MUL: case OP_MULL: case OP_MULK: return 0x0faf;
+    case OP_AND: case OP_ANDL: case OP_ANDK: return 0x23;
+    case OP_OR:  case OP_ORL:  case OP_ORK:  return 0x0b;
+    case OP_XOR: case OP_XORL: case OP_XORK: return 0x33;
+    default: return -1;
+    }
+}
+
+// Condition codes for comparison instructions
+static int cmp_cc(int op) {
+    switch (op) {
+    case OP_EQ: case OP_EQL: case OP_EQK:
+    case OP_EQJZ: case OP_EQLJZ: case OP_EQKJZ: return CC_E;
+    case OP_NE: case OP_NEL: case OP_NEK:
+    case OP_NEJZ: case OP_NELJZ: case OP_NEKJZ: return CC_NE;
+    case OP_GT: case OP_GTL: case OP_GTK:
+    case OP_GTJZ: case OP_GTLJZ: case OP_GTKJZ: return CC_G;
+    case OP_GE: case OP_GEL: case OP_GEK:
+    case OP_GEJZ: case OP_GELJZ: case OP_GEKJZ: return CC_GE;
+    case OP_LT: case OP_LTL: case OP_LTK:
+    case OP_LTJZ: case OP_LTLJZ: case OP_LTKJZ: return CC_L;
+    case OP_LE: case OP_LEL: case OP_LEK:
+    case OP_LEJZ: case OP_LELJZ: case OP_LEKJZ: return CC_LE;
+    default: return -1;
+    }
+}
+
+// Quickened instructions compile like their generic forms
+#define QUICKENED(x) case OP_I##x: case OP_F##x: return OP_##x;
+
+static int generic_op(int op) {
+    switch (op) {
+    QUICKEN_DEF(QUICKENED)
+    default: return op;
+    }
+}
+
+#define JUMP8(b)  ((int8_t) (b)[1])
+#define JUMP16(b) (*(int16_t *) &(b)[1])
+
+// Emit the template for the instruction at location i. Returns 0 if there is
+// none, without emitting anything.
+static int compile_ins(jit_buf *j, uint8_t *code, int i) {
+    uint8_t *b = &code[i];
+    int op = generic_op(*b);
+    switch (op) {
+    case OP_JMP:    jump(j, -1, i + JUMP8(b), 0);         break;
+    case OP_JMP16:  jump(j, -1, i + JUMP16(b), 0);        break;
+    case OP_JZ:     test_jump(j, i, CC_E,  i + JUMP8(b));  break;
+    case OP_JZ16:   test_jump(j, i, CC_E,  i + JUMP16(b)); break;
+    case OP_JNZ:    test_jump(j, i, CC_NE, i + JUMP8(b));  break;
+    case OP_JNZ16:  test_jump(j, i, CC_NE, i + JUMP16(b)); break;
+    case OP_POP:    add_sp(j, -1);                        break;
+    case OP_NULL:   push_imm(j, TYPE_NULL, 0);            break;
+    case OP_ZERO:   push_imm(j, TYPE_INT, 0);             break;
+    case OP_ONE:    push_imm(j, TYPE_INT, 1);             break;
+    case OP_IMM:    push_imm(j, TYPE_INT, b[1]);          break;
+    case OP_IMM16:  push_imm(j, TYPE_INT, *(uint16_t *) &b[1]); break;
+    case OP_LCLV0:
+    case OP_LCLV1:
+    case OP_LCLV2:
+        copy_slot(j, SP, 0, FP, op - OP_LCLV0);
+        add_sp(j, 1);
+        break;
+    case OP_LCLV:
+        copy_slot(j, SP, 0, FP, b[1]);
+        add_sp(j, 1);
+        break;
+    case OP_STL:
+    case OP_STLP:
+        copy_slot(j, FP, b[1], SP, -1);
+        if (op == OP_STLP)
+            add_sp(j, -1);
+        break;
+    case OP_INCL:
+    case OP_DECL:
+        guard_int(j, FP, b[1], i);
+        op_mem(j, 1, 0xff, op == OP_DECL, FP, INTOF(b[1])); // inc/dec qword
+        break;
+    case OP_ADDLL:
+        guard_int(j, FP, b[1], i);
+        guard_int(j, FP, b[2], i);
+        op_mem(j, 1, 0x8b, RAX, FP, INTOF(b[1]));
+        op_mem(j, 1, 0x03, RAX, FP, INTOF(b[2]));
+        op_mem(j, 1, 0xc7, 0, SP, SLOT(0));
+        emit32(j, TYPE_INT);
+        op_mem(j, 1, 0x89, RAX, SP, INTOF(0));
+        add_sp(j, 1);
+        break;
+    case OP_ADDXLL:
+        guard_int(j, FP, b[1], i);
+        guard_int(j, FP, b[2], i);
+        op_mem(j, 1, 0x8b, RAX, FP, INTOF(b[2]));
+        op_mem(j, 1, 0x01, RAX, FP, INTOF(b[1])); // add [fp+x], rax
+        break;
+    case OP_ADD: case OP_SUB: case OP_MUL:
+    case OP_AND: case OP_OR:  case OP_XOR:
+        arith(j, i, OPND_STACK, 0, arith_op(op));
+        break;
+    case OP_ADDL: case OP_SUBL: case OP_MULL:
+    case OP_ANDL: case OP_ORL:  case OP_XORL:
+        arith(j, i, OPND_LOCAL, b[1], arith_op(op));
+        break;
+    case OP_ADDK: case OP_SUBK: case OP_MULK:
+    case OP_ANDK: case OP_ORK:  case OP_XORK:
+        arith(j, i, OPND_IMM, b[1], arith_op(op));
+        break;
+    case OP_EQ: case OP_NE: case OP_GT:
+    case OP_GE: case OP_LT: case OP_LE:
+        compare(j, i, OPND_STACK, 0, cmp_cc(op));
+        break;
+    case OP_EQL: case OP_NEL: case OP_GTL:
+    case OP_GEL: case OP_LTL: case OP_LEL:
+        compare(j, i, OPND_LOCAL, b[1], cmp_cc(op));
+        break;
+    case OP_EQK: case OP_NEK: case OP_GTK:
+    case OP_GEK: case OP_LTK: case OP_LEK:
+        compare(j, i, OPND_IMM, b[1], cmp_cc(op));
+        break;
+    case OP_EQJZ: case OP_NEJZ: case OP_GTJZ:
+    case OP_GEJZ: case OP_LTJZ: case OP_LEJZ:
+        compare_jump(j, i, OPND_STACK, 0, cmp_cc(op), i + JUMP16(b));
+        break;
+    case OP_EQLJZ: case OP_NELJZ: case OP_GTLJZ:
+    case OP_GELJZ: case OP_LTLJZ: case OP_LELJZ:
+        compare_jump(j, i, OPND_LOCAL, b[3], cmp_cc(op), i + JUMP16(b));
+        break;
+    case OP_EQKJZ: case OP_NEKJZ: case OP_GTKJZ:
+    case OP_GEKJZ: case OP_LTKJZ: case OP_LEKJZ:
+        compare_jump(j, i, OPND_IMM, b[3], cmp_cc(op), i + JUMP16(b));
+        break;
+    default:
+        return 0;
+    }
+    return 1;
+}
+
+void riff_jit_compile(riff_code *c) {
+    jit_buf buf, *j = &buf;
+    riff_vec_init(&j->b);
+    riff_vec_init(&j->f);
+    j->pos   = malloc((c->n + 1) * sizeof(int));
+    int *map = malloc((c->n + 1) * sizeof(int));
+    int *stub = malloc((c->n + 1) * sizeof(int));
+    for (int i = 0; i <= c->n; ++i)
+        j->pos[i] = map[i] = stub[i] = -1;
+
+    // Trampoline
+    EMIT(0x53,                  // push rbx
+         0x41, 0x54,            // push r12
+         0x41, 0x55,            // push r13
+         0x49, 0x89, 0xfd,      // mov r13, rdi
+         0x48, 0x8b, 0x1f,      // mov rbx, [rdi]
+         0x49, 0x89, 0xf4,      // mov r12, rsi
+         0xff, 0xe2);           // jmp rdx
+
+    // Common exit sequence; the bytecode location to resume at is in EAX
+    j->exit = j->b.n;
+    EMIT(0x49, 0x89, 0x5d, 0x00, // mov [r13], rbx
+         0x41, 0x5d,            // pop r13
+         0x41, 0x5c,            // pop r12
+         0x5b,                  // pop rbx
+         0xc3);                 // ret
+
+    for (int i = 0; i < c->n; i += arity[c->code[i]] + 1) {
+        j->pos[i] = j->b.n;
+        if (compile_ins(j, c->code, i))
+            map[i] = j->pos[i];
+        else
+            exit_to(j, i);
+    }
+
+    // Exit stubs for guards, and for jumps to anything other than the start
+    // of an instruction
+    RIFF_VEC_FOREACH(&j->f, i) {
+        jit_fixup *f = &RIFF_VEC_GET(&j->f, i);
+        if (f->loc < 0 || f->loc > c->n) {
+            f->loc = c->n;
+            f->exit = 1;
+        } else if (j->pos[f->loc] < 0) {
+            f->exit = 1;
+        }
+        if (f->exit && stub[f->loc] < 0) {
+            stub[f->loc] = j->b.n;
+            exit_to(j, f->loc);
+        }
+    }
+    RIFF_VEC_FOREACH(&j->f, i) {
+        jit_fixup *f = &RIFF_VEC_GET(&j->f, i);
+        int32_t rel = (f->exit ? stub[f->loc] : j->pos[f->loc]) - (f->at + 4);
+        memcpy(&j->b.list[f->at], &rel, 4);
+    }
+
+    uint8_t *mem = mmap(NULL, j->b.n, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem != MAP_FAILED) {
+        memcpy(mem, j->b.list, j->b.n);
+        if (!mprotect(mem, j->b.n, PROT_READ | PROT_EXEC)) {
+            riff_jit *jit = malloc(sizeof(riff_jit));
+            jit->enter = (int (*)(vm_stack **, vm_stack *, uint8_t *)) (void *) mem;
+            jit->mem   = mem;
+            jit->size  = j->b.n;
+            jit->map   = map;
+            c->jit = jit;
+            map = NULL;
+        } else {
+            munmap(mem, j->b.n);
+        }
+    }
+
+    // Don't retry if native code couldn't be mapped
+    if (map) {
+        c->hot = INT_MIN;
+        free(map);
+    }
+    free(j->pos);
+    free(stub);
+    riff_vec_free(&j->b);
+    riff_vec_free(&j->f);
+}
+
+#endif
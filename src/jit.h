@@ -0,0 +1,50 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "code.h"
+#include "vm.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Baseline JIT compiler (x86-64 Linux)
+//
+// Once a code object has been called or looped JIT_HOT_COUNT times, it is
+// translated into native code by stitching together a machine code template
+// for each instruction. Loads and stores of locals, immediates, integer
+// arithmetic, comparisons and jumps are compiled inline behind type guards;
+// everything else (and any guard failure) exits to the interpreter at the
+// start of the instruction. Native code never allocates or calls into the
+// runtime, so it needs no GC safe points of its own.
+//
+// The interpreter enters native code at function entry and after backward
+// jumps, and resumes at whichever location it exits at.
+
+#if defined(__x86_64__) && defined(__linux__)
+#define RIFF_JIT
+#endif
+
+typedef struct riff_jit riff_jit;
+
+struct riff_jit {
+    // Trampoline: loads SP from the first argument, jumps to the native
+    // address given, and returns the bytecode location to resume at after
+    // storing SP back
+    int     (*enter)(vm_stack **, vm_stack *, uint8_t *);
+    uint8_t  *mem;   // Executable mapping
+    size_t    size;  // Size of mapping
+    int      *map;   // Native offset for each bytecode location (-1 if none)
+};
+
+// Set by the -j command-line option
+extern int riff_jit_enabled;
+
+void riff_jit_compile(riff_code *);
+
+// Run native code starting at bytecode location loc. Returns the location the
+// interpreter should resume at.
+static inline int riff_jit_exec(riff_jit *j, int loc, vm_stack **sp, vm_stack *fp) {
+    return j->enter(sp, fp, j->mem + j->map[loc]);
+}
+
+#endif
@@ -318,6 +318,7 @@ re_start:
         pcre2_get_error_message(errcode, errstr, 0x200);
         err(x, (const char *) errstr);
     }
+    re_jit_compile(r);
     tk->r = r;
     return RIFF_TK_REGEX;
 }
@@ -51,10 +51,21 @@ static inline int build_char_str(riff_val *fp, int argc, char *buf) {
 static inline void fputs_val(FILE *f, riff_val *v) {
     char buf[STR_BUF_SZ];
     char *p = buf;
-    riff_tostr(v, &p);
-    fputs(p, f);
+    size_t n = riff_tostr(v, &p);
+    fwrite(p, 1, n, f);
 }
 
+// Buffered standard output (see lib_io.c)
+extern int riff_out_unbuffered;
+
+void riff_out_write(const char *, size_t);
+void riff_out_val(riff_val *);
+void riff_out_flush(void);
+
+// Input records for -n/-p (see lib_io.c)
+void        riff_io_set_input(char **, int);
+const char *riff_io_next_record(size_t *);
+
 void riff_lib_register_base(riff_htab *);
 void riff_lib_register_io(riff_htab *);
 void riff_lib_register_math(riff_htab *);
@@ -45,7 +45,7 @@ LIB_FN(eval) {
     riff_state s;
 
     riff_state_init(&s);
-    s.src = fp->s->str;
+    s.src = riff_str_cstr(fp->s);
     riff_compile(&s);
     riff_exec_reenter(&s, (vm_stack *) fp);
     return 0;
@@ -72,7 +72,7 @@ LIB_FN(num) {
     }
     char *end;
     errno = 0;
-    riff_int i = riff_strtoll(fp->s->str, &end, base);
+    riff_int i = riff_strtoll(riff_str_cstr(fp->s), &end, base);
     if (errno == ERANGE || isdigit(*end)) {
         goto ret_flt;
     }
@@ -89,17 +89,17 @@ LIB_FN(num) {
     set_int(fp-1, i);
     return 1;
 ret_flt:
-    set_flt(fp-1, riff_strtod(fp->s->str, &end, base));
+    set_flt(fp-1, riff_strtod(riff_str_cstr(fp->s), &end, base));
     return 1;
 }
 
 // print(...)
 LIB_FN(print) {
     for (int i = 0; i < argc; ++i) {
-        if (i) fputs(" ", stdout);
-        fputs_val(stdout, fp+i);
+        if (i) riff_out_write(" ", 1);
+        riff_out_val(fp+i);
     }
-    fputs("\n", stdout);
+    riff_out_write("\n", 1);
     set_int(fp-1, argc);
     return 1;
 }
@@ -3,41 +3,152 @@
 #include "buf.h"
 #include "conf.h"
 #include "fmt.h"
+#include "gc.h"
 #include "string.h"
 
 #include <errno.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 static void err(const char *msg) {
     fprintf(stderr, "riff: %s\n", msg);
     exit(1);
 }
 
+// Set by register_streams(); default file for read() and getc()
+static riff_file *stdin_file;
+
+static void release_buf(riff_file *);
+
+// Buffered standard output
+//
+// print(), printf(), putc() and write() append to a buffer owned by riff
+// instead of going through stdio for every value; numbers are formatted
+// directly into it. The buffer is written out when full, by flush() and at
+// exit. If stdout is a terminal, it is also written out after each newline.
+// stdio's own buffering of stdout is disabled so each write-out is a single
+// write(2). Files returned by open() keep stdio's buffering.
+
+enum { OUT_FULL, OUT_LINE, OUT_NONE };
+
+// Set by the -u command-line option
+int riff_out_unbuffered = 0;
+
+static struct {
+    int    mode;
+    size_t n;
+    char   buf[OUT_BUF_SZ];
+} out;
+
+// Enough room for a number formatted by riff_tostr()
+#define OUT_NUM_MAX 32
+
+static void out_drain(void) {
+    if (out.n) {
+        fwrite(out.buf, 1, out.n, stdout);
+        out.n = 0;
+    }
+}
+
+static inline void out_sync(const char *s, size_t n) {
+    if (riff_unlikely(out.mode != OUT_FULL)) {
+        if (out.mode == OUT_NONE || memchr(s, '\n', n))
+            riff_out_flush();
+    }
+}
+
+void riff_out_flush(void) {
+    out_drain();
+    fflush(stdout);
+}
+
+void riff_out_write(const char *s, size_t n) {
+    if (riff_unlikely(n > OUT_BUF_SZ - out.n)) {
+        out_drain();
+        if (n > OUT_BUF_SZ) {
+            fwrite(s, 1, n, stdout);
+            return;
+        }
+    }
+    memcpy(out.buf + out.n, s, n);
+    out.n += n;
+    out_sync(s, n);
+}
+
+void riff_out_val(riff_val *v) {
+    if (is_str(v)) {
+        riff_out_write(riff_str_cstr(v->s), riff_strlen(v->s));
+        return;
+    }
+    // Numbers are formatted in place; other values (ranges, tables, etc.)
+    // go through a local buffer
+    if (!is_num(v)) {
+        char buf[STR_BUF_SZ];
+        char *p = buf;
+        size_t n = riff_tostr(v, &p);
+        riff_out_write(p, n);
+        return;
+    }
+    if (riff_unlikely(OUT_BUF_SZ - out.n < OUT_NUM_MAX))
+        out_drain();
+    char *p = out.buf + out.n;
+    size_t n = riff_tostr(v, &p);
+    out.n += n;
+    out_sync(p, n);
+}
+
+static void out_init(void) {
+    static int init = 0;
+    if (riff_out_unbuffered)
+        out.mode = OUT_NONE;
+    else if (isatty(fileno(stdout)))
+        out.mode = OUT_LINE;
+    else
+        out.mode = OUT_FULL;
+    if (!init) {
+        setvbuf(stdout, NULL, _IONBF, 0);
+        atexit(riff_out_flush);
+        init = 1;
+    }
+}
+
 // I/O functions
 
 // close(f)
 LIB_FN(close) {
-    if (is_file(fp))
-        if (!(fp->fh->flags & FH_STD))
+    if (is_file(fp)) {
+        if (!(fp->fh->flags & (FH_STD | FH_CLOSED))) {
             fclose(fp->fh->p);
+            fp->fh->flags |= FH_CLOSED;
+            release_buf(fp->fh);
+        }
+    }
     return 0;
 }
 
 // flush([f])
 LIB_FN(flush) {
     FILE *f = argc && is_file(fp) ? fp->fh->p : stdout;
+    if (f == stdout) {
+        out_drain();
+    }
     if (fflush(f)) {
         err("error flushing stream");
     }
     return 0;
 }
 
+static int read_char(riff_file *);
+
 // getc([f])
 LIB_FN(getc) {
     riff_int c;
-    FILE *f = argc && is_file(fp) ? fp->fh->p : stdin;
-    if ((c = fgetc(f)) != EOF) {
+    riff_file *fh = argc && is_file(fp) ? fp->fh : stdin_file;
+    if ((c = read_char(fh)) != EOF) {
         set_int(fp-1, c);
         return 1;
     }
@@ -56,25 +167,35 @@ LIB_FN(open) {
     if (!is_str(fp))
         return 0;
     FILE *p;
+    char *path = riff_str_cstr(fp[0].s);
+    char *mode = NULL;
     errno = 0;
     if (argc == 1 || !is_str(fp+1)) {
-        p = fopen(fp[0].s->str, "r");
+        p = fopen(path, "r");
     } else {
-        if (!valid_fmode(fp[1].s->str)) {
+        mode = riff_str_cstr(fp[1].s);
+        if (!valid_fmode(mode)) {
             fprintf(stderr, "riff: error opening '%s': invalid file mode: '%s'\n",
-                    fp[0].s->str, fp[1].s->str);
+                    path, mode);
             exit(1);
         }
-        p = fopen(fp[0].s->str, fp[1].s->str);
+        p = fopen(path, mode);
     }
     if (!p) {
         fprintf(stderr, "riff: error opening '%s': %s\n",
-                fp[0].s->str, strerror(errno));
+                path, strerror(errno));
         exit(1);
     }
-    riff_file *fh = malloc(sizeof(riff_file));
+    riff_file *fh = riff_gc_new(sizeof(riff_file), GC_OBJ_FILE);
     fh->p = p;
-    fh->flags = 0;
+
+    // Read-only files bypass stdio when reading. Files also open for
+    // writing are left to stdio, which keeps reads and writes in sync with
+    // the stream's position.
+    fh->flags = argc == 1 || !is_str(fp+1) || !strcmp(mode, "r") || !strcmp(mode, "rb")
+              ? FH_RBUF : 0;
+    fh->rbuf = NULL;
+    fh->rpos = fh->rlen = fh->rcap = 0;
     fp[-1] = (riff_val) {TYPE_FILE, .fh = fh};
     return 1;
 }
@@ -87,10 +208,11 @@ LIB_FN(printf) {
         return l_write(fp, argc);
     }
     --argc;
-    char buf[STR_BUF_SZ];
-    int n = fmt_snprintf(buf, sizeof buf, fp->s->str, fp + 1, argc);
-    buf[n] = '\0';
-    fputs(buf, stdout);
+    // Reused across calls
+    static riff_buf buf;
+    buf.n = 0;
+    size_t n = fmt_bprintf(&buf, riff_str_cstr(fp->s), fp + 1, argc);
+    riff_out_write(buf.list, n);
     return 0;
 }
 
@@ -104,20 +226,163 @@ LIB_FN(putc) {
         return 0;
     char buf[STR_BUF_SZ];
     int n = build_char_str(fp, argc, buf);
-    buf[n] = '\0';
-    fputs(buf, stdout);
+    riff_out_write(buf, n);
     set_int(fp-1, n);
     return 1;
 }
 
 #define READ_BUF_SZ 0x10000
 
-static inline int read_bytes(FILE *f, riff_int n, riff_str **ret) {
+// Buffered reading (FH_RBUF)
+// Data is read with read(2) into a buffer owned by the file handle, and lines
+// are found with memchr(). Each string read is copied out of the buffer once.
+//
+// Regular files of at least MMAP_MIN_SIZE bytes are mapped into memory on the
+// first read instead (FH_MMAP), and the mapping serves as the buffer. Data is
+// copied straight out of the page cache, and reading the whole file makes a
+// single copy rather than growing a buffer. Like any mapping, truncating the
+// file while it's being read raises SIGBUS.
+
+static int map_file(riff_file *fh) {
+    int fd = fileno(fh->p);
+    struct stat st;
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size < MMAP_MIN_SIZE)
+        return 0;
+    off_t off = lseek(fd, 0, SEEK_CUR);
+    if (off < 0 || off >= st.st_size)
+        return 0;
+    char *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED)
+        return 0;
+#ifdef MADV_SEQUENTIAL
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
+#endif
+#ifdef MADV_HUGEPAGE
+    madvise(p, st.st_size, MADV_HUGEPAGE);
+#endif
+    // Leave the descriptor at EOF, as if the file had been read
+    lseek(fd, 0, SEEK_END);
+    fh->flags |= FH_MMAP;
+    fh->rbuf = p;
+    fh->rpos = off;
+    fh->rlen = fh->rcap = st.st_size;
+    return 1;
+}
+
+static void release_buf(riff_file *fh) {
+    if (fh->flags & FH_MMAP)
+        munmap(fh->rbuf, fh->rcap);
+    else
+        free(fh->rbuf);
+    fh->flags &= ~FH_MMAP;
+    fh->rbuf = NULL;
+    fh->rpos = fh->rlen = fh->rcap = 0;
+}
+
+// Read more data into the buffer, moving unconsumed data to the front and
+// growing the buffer if it's full. Returns the number of bytes read (0 on EOF
+// or error).
+static size_t fill(riff_file *fh) {
+    if (fh->flags & FH_MMAP)
+        return 0;
+    if (fh->rbuf == NULL && map_file(fh))
+        return fh->rlen - fh->rpos;
+    if (fh->rpos) {
+        memmove(fh->rbuf, fh->rbuf + fh->rpos, fh->rlen - fh->rpos);
+        fh->rlen -= fh->rpos;
+        fh->rpos = 0;
+    }
+    if (fh->rlen == fh->rcap) {
+        fh->rcap = fh->rcap ? fh->rcap * 2 : READ_BUF_SZ;
+        fh->rbuf = realloc(fh->rbuf, fh->rcap);
+    }
+    ssize_t n;
+    do {
+        n = read(fileno(fh->p), fh->rbuf + fh->rlen, fh->rcap - fh->rlen);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0)
+        return 0;
+    fh->rlen += n;
+    return n;
+}
+
+static inline int rb_char(riff_file *fh) {
+    if (fh->rpos == fh->rlen && !fill(fh))
+        return EOF;
+    return (unsigned char) fh->rbuf[fh->rpos++];
+}
+
+static inline int rb_bytes(riff_file *fh, size_t n, riff_str **ret) {
+    if (n) {
+        while (fh->rlen - fh->rpos < n && fill(fh));
+        size_t nr = fh->rlen - fh->rpos;
+        if (nr > n)
+            nr = n;
+        *ret = riff_str_new_tmp(fh->rbuf + fh->rpos, nr);
+        fh->rpos += nr;
+        return nr > 0;
+    } else {
+        return -(fh->rpos < fh->rlen || fill(fh));
+    }
+}
+
+// Consume the next line, returning its position in the buffer; valid until
+// the next read. The final line may lack a newline.
+static inline char *rb_next_line(riff_file *fh, size_t *len) {
+    size_t scanned = 0;
+    char *nl = NULL;
+    while (1) {
+        size_t avail = fh->rlen - fh->rpos;
+        if (avail > scanned &&
+                (nl = memchr(fh->rbuf + fh->rpos + scanned, '\n', avail - scanned)))
+            break;
+        scanned = avail;
+        if (!fill(fh))
+            break;
+    }
+    char *p = fh->rbuf + fh->rpos;
+    *len = nl ? (size_t) (nl - p) : fh->rlen - fh->rpos;
+    fh->rpos += *len + !!nl;
+    return p;
+}
+
+static inline int rb_line(riff_file *fh, riff_str **ret) {
+    size_t n;
+    char *p = rb_next_line(fh, &n);
+    *ret = riff_str_new_tmp(p, n);
+    return 1;
+}
+
+static inline int rb_all(riff_file *fh, riff_str **ret) {
+    while (fill(fh));
+    *ret = riff_str_new_tmp(fh->rbuf + fh->rpos, fh->rlen - fh->rpos);
+
+    // Release the buffer, which holds the whole file at this point
+    release_buf(fh);
+    return 1;
+}
+
+// Unbuffered (stdio) reading, for files open for both reading and writing
+
+static int read_char(riff_file *fh) {
+    if (riff_unlikely(fh->flags & FH_CLOSED))
+        return EOF;
+    if (fh->flags & FH_RBUF)
+        return rb_char(fh);
+    return fgetc(fh->p);
+}
+
+static inline int read_bytes(riff_file *fh, riff_int n, riff_str **ret) {
+    if (n < 0)
+        n = 0;
+    if (fh->flags & FH_RBUF)
+        return rb_bytes(fh, n, ret);
+    FILE *f = fh->p;
     if (n) {
         riff_buf buf;
         riff_buf_init_size(&buf, n);
         size_t nr = fread(buf.list, sizeof (char), n, f);
-        *ret = riff_str_new(buf.list, nr);
+        *ret = riff_str_new_tmp(buf.list, nr);
         riff_buf_free(&buf);
         return nr > 0;
     } else {
@@ -127,7 +392,10 @@ static inline int read_bytes(FILE *f, riff_int n, riff_str **ret) {
     }
 }
 
-static inline int read_line(FILE *f, riff_str **ret) {
+static inline int read_line(riff_file *fh, riff_str **ret) {
+    if (fh->flags & FH_RBUF)
+        return rb_line(fh, ret);
+    FILE *f = fh->p;
     riff_buf buf;
     size_t m = READ_BUF_SZ;
     riff_buf_init_size(&buf, m);
@@ -145,34 +413,37 @@ static inline int read_line(FILE *f, riff_str **ret) {
             m += m;
         }
     }
-    *ret = riff_str_new(buf.list, buf.n);
+    *ret = riff_str_new_tmp(buf.list, buf.n);
     riff_buf_free(&buf);
     return 1;
 }
 
-static inline int read_all(FILE *f, riff_str **ret) {
+static inline int read_all(riff_file *fh, riff_str **ret) {
+    if (fh->flags & FH_RBUF)
+        return rb_all(fh, ret);
+    FILE *f = fh->p;
     riff_buf buf;
     size_t m = READ_BUF_SZ;
     riff_buf_init_size(&buf, m);
     do {
+        m += m;
         riff_buf_resize(&buf, m);
         buf.n += fread(buf.list + buf.n, sizeof (char), m - buf.n, f);
-        m += m;
     } while (buf.n == m);
-    *ret = riff_str_new(buf.list, buf.n);
+    *ret = riff_str_new_tmp(buf.list, buf.n);
     riff_buf_free(&buf);
     return 1;
 }
 
-static inline int read_file_mode(FILE *f, char *mode, riff_str **ret) {
+static inline int read_file_mode(riff_file *fh, char *mode, riff_str **ret) {
     switch (*mode) {
     case 'A':
     case 'a':
-        return read_all(f, ret);
+        return read_all(fh, ret);
     case 'L':
     case 'l':
     default:
-        return read_line(f, ret);
+        return read_line(fh, ret);
     }
 }
 
@@ -180,24 +451,21 @@ static inline int read_file_mode(FILE *f, char *mode, riff_str **ret) {
 LIB_FN(read) {
     riff_str *ret = NULL;
     int res = 0;
-    if (!argc) {
-        res = read_line(stdin, &ret);
-    } else if (!is_file(fp)) {
-        if (is_str(fp)) {
-            res = read_file_mode(stdin, fp->s->str, &ret);
-        } else {
-            res = read_bytes(stdin, intval(fp), &ret);
-        }
-    } else if (is_file(fp)) {
-        if (argc == 1) {
-            res = read_line(fp->fh->p, &ret);
-        } else {
-            if (is_str(fp+1)) {
-                res = read_file_mode(fp->fh->p, fp[1].s->str, &ret);
-            } else {
-                res = read_bytes(fp->fh->p, intval(fp+1), &ret);
-            }
-        }
+    riff_file *fh = stdin_file;
+    riff_val *arg = fp;
+    if (argc && is_file(fp)) {
+        fh = fp->fh;
+        ++arg;
+        --argc;
+    }
+    if (riff_unlikely(fh->flags & FH_CLOSED)) {
+        res = 0;
+    } else if (!argc) {
+        res = read_line(fh, &ret);
+    } else if (is_str(arg)) {
+        res = read_file_mode(fh, riff_str_cstr(arg->s), &ret);
+    } else {
+        res = read_bytes(fh, intval(arg), &ret);
     }
 
     if (riff_likely(res > 0)) {
@@ -208,13 +476,70 @@ LIB_FN(read) {
     return 1;
 }
 
+// Input records (-n/-p)
+// Lines are read from each file named in turn, or from stdin if there are
+// none. Records are handed to the VM straight out of the read buffer. Reading
+// stdin goes through the same file handle as read(), so the two can be mixed.
+
+static struct {
+    char     **paths;
+    int        n;
+    int        i;
+    riff_file *fh;
+    riff_file  file;
+} input;
+
+void riff_io_set_input(char **paths, int n) {
+    input.paths = paths;
+    input.n = n;
+    input.i = 0;
+    input.fh = NULL;
+}
+
+static riff_file *next_input(void) {
+    if (input.i >= (input.n ? input.n : 1))
+        return NULL;
+    const char *path = input.n ? input.paths[input.i] : "-";
+    ++input.i;
+    if (!strcmp(path, "-"))
+        return stdin_file;
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        fprintf(stderr, "riff: file not found: %s\n", path);
+        exit(1);
+    }
+    input.file = (riff_file) {.p = f, .flags = FH_RBUF};
+    return &input.file;
+}
+
+// Return the next record and set `*len` to its length, or return NULL once
+// all input is exhausted. The record is valid until the next call.
+const char *riff_io_next_record(size_t *len) {
+    while (1) {
+        if (input.fh == NULL && (input.fh = next_input()) == NULL)
+            return NULL;
+        riff_file *fh = input.fh;
+        if (!(fh->flags & FH_CLOSED) &&
+                (fh->rpos < fh->rlen || fill(fh)))
+            return rb_next_line(fh, len);
+        if (fh == &input.file) {
+            fclose(fh->p);
+            release_buf(fh);
+        }
+        input.fh = NULL;
+    }
+}
+
 // write(v[,f])
 LIB_FN(write) {
     if (riff_unlikely(!argc)) {
         return 0;
     }
     FILE *f = argc > 1 && is_file(fp+1) ? fp[1].fh->p : stdout;
-    fputs_val(f, fp);
+    if (f == stdout)
+        riff_out_val(fp);
+    else
+        fputs_val(f, fp);
     return 0;
 }
 
@@ -233,13 +558,15 @@ static riff_lib_fn_reg iolib[] = {
 // lib functions since the names (e.g. stdin) aren't compile-time constants
 #define REGISTER_LIB_STREAM(name) \
     riff_file *name##_fh = malloc(sizeof(riff_file)); \
-    *name##_fh = (riff_file) {name, FH_STD}; \
+    *name##_fh = (riff_file) {.p = name, .flags = FH_STD}; \
     riff_htab_insert_cstr(g, #name, &(riff_val){TYPE_FILE, .fh = name##_fh});
 
 static void register_streams(riff_htab *g) {
     REGISTER_LIB_STREAM(stdin);
     REGISTER_LIB_STREAM(stdout);
     REGISTER_LIB_STREAM(stderr);
+    stdin_fh->flags |= FH_RBUF;
+    stdin_file = stdin_fh;
 }
 
 void riff_lib_register_io(riff_htab *g) {
@@ -247,4 +574,5 @@ void riff_lib_register_io(riff_htab *g) {
         riff_htab_insert_cstr(g, iolib[i].name, &(riff_val) {TYPE_CFN, .cfn = &iolib[i].fn});
     }
     register_streams(g);
+    out_init();
 }
@@ -1,6 +1,7 @@
 #include "lib.h"
 
 #include "fmt.h"
+#include "gc.h"
 #include "string.h"
 
 #include <ctype.h>
@@ -16,10 +17,12 @@
 LIB_FN(byte) {
     int idx = argc > 1 ? intval(fp+1) : 0;
     if (is_str(fp)) {
-        if (idx > riff_strlen(fp->s)) {
-            idx = riff_strlen(fp->s);
+        // Views aren't NUL-terminated; out-of-bounds indices give 0
+        if (idx < 0 || idx >= riff_strlen(fp->s)) {
+            set_int(fp-1, 0);
+        } else {
+            set_int(fp-1, (uint8_t) fp->s->str[idx]);
         }
-        set_int(fp-1, (uint8_t) fp->s->str[idx]);
     } else {
         set_int(fp-1, 0);
     }
@@ -47,13 +50,30 @@ LIB_FN(fmt) {
         return 0;
     }
     --argc;
-    char buf[STR_BUF_SZ];
-    int n = fmt_snprintf(buf, sizeof buf, fp->s->str, fp + 1, argc);
-    set_str(fp-1, riff_str_new(buf, n));
+    // Reused across calls
+    static riff_buf buf;
+    buf.n = 0;
+    size_t n = fmt_bprintf(&buf, riff_str_cstr(fp->s), fp + 1, argc);
+    set_str(fp-1, riff_str_new_tmp(buf.list, n));
     return 1;
 }
 
+// Compile a string pattern passed to [g]sub() or split(), via the regex
+// cache
+static riff_regex *str_pattern(const char *fname, char *p, size_t len) {
+    int errcode;
+    riff_regex *re = re_compile_cached(p, len, 0, &errcode);
+    if (riff_unlikely(re == NULL)) {
+        PCRE2_UCHAR errstr[0x200];
+        pcre2_get_error_message(errcode, errstr, 0x200);
+        fprintf(stderr, "riff: [%s] %s\n", fname, errstr);
+        exit(1);
+    }
+    return re;
+}
+
 static int xsub(riff_val *fp, int argc, int flags) {
+    const char *fname = flags & PCRE2_SUBSTITUTE_GLOBAL ? "gsub" : "sub";
     char  *s;
     riff_regex *p;
     char  *r;
@@ -78,16 +98,16 @@ static int xsub(riff_val *fp, int argc, int flags) {
 
     // Pattern `p`
     if (!is_regex(fp+1)) {
-        int errcode;
         if (is_num(fp+1)) {
             char temp_p[32];
+            size_t plen;
             if (is_int(fp+1))
-                riff_lltostr(fp[1].i, temp_p);
-            else if (is_float(fp+1))
-                riff_dtostr(fp[1].f, temp_p);
-            p = re_compile(temp_p, PCRE2_ZERO_TERMINATED, 0, &errcode);
+                plen = riff_lltostr(fp[1].i, temp_p);
+            else
+                plen = riff_dtostr(fp[1].f, temp_p);
+            p = str_pattern(fname, temp_p, plen);
         } else if (is_str(fp+1)) {
-            p = re_compile(fp[1].s->str, riff_strlen(fp[1].s), 0, &errcode);
+            p = str_pattern(fname, fp[1].s->str, riff_strlen(fp[1].s));
         } else {
             return 0;
         }
@@ -106,7 +126,7 @@ static int xsub(riff_val *fp, int argc, int flags) {
                 temp_r[0] = '\0';
             r = temp_r;
         } else {
-            r = fp[2].s->str;
+            r = riff_str_cstr(fp[2].s);
         }
     }
 
@@ -117,37 +137,58 @@ static int xsub(riff_val *fp, int argc, int flags) {
         r = temp_r;
     }
 
-    char   buf[STR_BUF_SZ];
+    char   sbuf[STR_BUF_SZ];
+    char  *buf = sbuf;
     size_t n = STR_BUF_SZ;
 
-    // Create match data for storing captured subexpressions
-    pcre2_match_data *md = pcre2_match_data_create_from_pattern(p, NULL);
+    // Match data for storing captured subexpressions
+    pcre2_match_data *md = re_match_data(p);
 
     // In order to properly capture substrings resulting from the
     // substitution pattern, PCRE2 match data must be passed to a
     // PCRE2 match operation with the same pattern and subject string
-    // before performing the actual subtitution
-    pcre2_match(p, (PCRE2_SPTR) s, len, 0, 0, md, NULL);
+    // before performing the actual subtitution. If the result doesn't fit
+    // in the stack buffer, `n` is set to the required size and both steps
+    // are redone with a heap buffer.
+    flags |= PCRE2_SUBSTITUTE_MATCHED | PCRE2_SUBSTITUTE_OVERFLOW_LENGTH;
+    while (1) {
 
-    // Perform the substitution
-    pcre2_substitute(
-            p,                      // Compiled regex
-            (PCRE2_SPTR) s,         // Original string pointer
-            len,                    // Original string length
-            0,                      // Start offset
-            PCRE2_SUBSTITUTE_MATCHED
-            | flags,                // Options/flags
-            md,                     // Match data block
-            NULL,                   // Match context
-            (PCRE2_SPTR) r,         // Replacement string pointer
-            PCRE2_ZERO_TERMINATED,  // Replacement string length
-            (PCRE2_UCHAR *) buf,    // Buffer for new string
-            &n);                    // Buffer size (overwritten w/ length)
+        // Without a match, `s` is returned unchanged. The match data may
+        // be stale if the match was ruled out before calling PCRE2.
+        if (re_exec(p, s, len, 0, md) < 0) {
+            if (buf != sbuf)
+                free(buf);
+            set_str(fp-1, riff_str_new_tmp(s, len));
+            return 1;
+        }
+
+        // Perform the substitution
+        int rc = pcre2_substitute(
+                p->code,                // Compiled regex
+                (PCRE2_SPTR) s,         // Original string pointer
+                len,                    // Original string length
+                0,                      // Start offset
+                flags,                  // Options/flags
+                md,                     // Match data block
+                re_match_context(),     // Match context
+                (PCRE2_SPTR) r,         // Replacement string pointer
+                PCRE2_ZERO_TERMINATED,  // Replacement string length
+                (PCRE2_UCHAR *) buf,    // Buffer for new string
+                &n);                    // Buffer size (overwritten w/ length)
+        if (riff_unlikely(rc == PCRE2_ERROR_JIT_STACKLIMIT)) {
+            flags |= RE_NO_JIT;
+            continue;
+        }
+        if (riff_likely(rc != PCRE2_ERROR_NOMEMORY))
+            break;
+        buf = buf == sbuf ? malloc(n) : realloc(buf, n);
+    }
 
     // Store capture substrings in the global fields table
-    re_store_numbered_captures(md);
-    pcre2_match_data_free(md);
-    set_str(fp-1, riff_str_new(buf, n));
+    re_store_numbered_captures(md, s);
+    set_str(fp-1, riff_str_new_tmp(buf, n));
+    if (buf != sbuf)
+        free(buf);
     return 1;
 }
 
@@ -189,7 +230,7 @@ LIB_FN(ord) {
     if (!is_str(fp))
         return 0;
     riff_int v = 0;
-    char *s = fp->s->str;
+    char *s = riff_str_cstr(fp->s);
     while (*s) {
         v <<= 8;
         if (*s & 0x80) {
@@ -221,7 +262,7 @@ LIB_FN(upper) { return allxcase(fp, 1); }
 LIB_FN(split) {
     char *str;
     size_t len = 0;
-    char temp_s[20];
+    char temp_s[32];
     if (!is_str(fp)) {
         if (is_int(fp)) {
             len = riff_lltostr(fp->i, temp_s);
@@ -238,48 +279,62 @@ LIB_FN(split) {
     if (len == 0)
         return 0;
     riff_str *s;
-    riff_tab *t = malloc(sizeof(riff_tab));
-    riff_tab_init(t);
+    riff_val tv;
+    v_newtab(&tv, 0);
+    riff_tab *t = tv.t;
     riff_regex *delim;
-    int errcode = 0;
     if (argc < 2) {
-        delim = re_compile("\\s+", PCRE2_ZERO_TERMINATED, 0, &errcode);
+        delim = str_pattern("split", "\\s+", 3);
     } else if (!is_regex(fp+1)) {
         char temp[32];
+        size_t tlen;
         switch (fp[1].type) {
-        case TYPE_INT: riff_lltostr(fp[1].i, temp); break;
-        case TYPE_FLOAT: riff_dtostr(fp[1].f, temp); break;
+        case TYPE_INT: tlen = riff_lltostr(fp[1].i, temp); break;
+        case TYPE_FLOAT: tlen = riff_dtostr(fp[1].f, temp); break;
         case TYPE_STR:
             if (!riff_strlen(fp[1].s))
                 goto split_chars;
-            delim = re_compile(fp[1].s->str, riff_strlen(fp[1].s), 0, &errcode);
+            delim = str_pattern("split", fp[1].s->str, riff_strlen(fp[1].s));
             goto do_split;
         default:
             goto split_chars;
         }
-        delim = re_compile(temp, PCRE2_ZERO_TERMINATED, 0, &errcode);
+        delim = str_pattern("split", temp, tlen);
     } else {
         delim = fp[1].r;
     }
 
     // Split on regular expression
 do_split: {
-    size_t n = len * 2;
-    char *buf = malloc(sizeof(char) * n);
+    // Every match adds at most one sentinel byte to the result, even if
+    // the pattern matches the empty string between each pair of bytes.
+    // One more byte is reserved for the extra terminator.
+    size_t n = len * 2 + 2;
+    char *buf = malloc(sizeof(char) * (n + 1));
     char *p = buf;
     char *sentinel = "\0";
-    int matches = pcre2_substitute(
-            delim,
-            (PCRE2_SPTR) str,
-            len,
-            0,
-            PCRE2_SUBSTITUTE_GLOBAL,
-            NULL,
-            NULL,
-            (PCRE2_SPTR) sentinel,
-            1,
-            (PCRE2_UCHAR *) buf,
-            &n);
+    uint32_t opts = PCRE2_SUBSTITUTE_GLOBAL;
+    int matches;
+
+    // Patterns exhausting the JIT stack are retried with the interpreter
+    while (1) {
+        matches = pcre2_substitute(
+                delim->code,
+                (PCRE2_SPTR) str,
+                len,
+                0,
+                opts,
+                re_match_data(delim),
+                re_match_context(),
+                (PCRE2_SPTR) sentinel,
+                1,
+                (PCRE2_UCHAR *) buf,
+                &n);
+        if (riff_likely(matches != PCRE2_ERROR_JIT_STACKLIMIT))
+            break;
+        opts |= RE_NO_JIT;
+        n = len * 2 + 2;
+    }
     if (riff_unlikely(matches < 0)) {
         PCRE2_UCHAR errstr[0x200];
         pcre2_get_error_message(matches, errstr, 0x200);
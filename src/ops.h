@@ -1,6 +1,7 @@
 #ifndef OPS_H
 #define OPS_H
 
+#include "buf.h"
 #include "conf.h"
 #include "string.h"
 #include "value.h"
@@ -37,9 +38,8 @@ static inline int riff_op_test(riff_val *v) {
     // If entire string is a numeric value, return logical result of the number.
     // Otherwise, return whether the string is longer than 0.
     case TYPE_STR: {
-        char *end;
-        riff_float f = riff_strtod(v->s->str, &end, 0);
-        if (!*end) {
+        if (riff_str_num(v->s) & RIFF_STR_HINT_NUMERIC) {
+            riff_float f = str2flt(v->s);
             // Check for literal '0' character in string
             return (f == 0.0 && riff_str_haszero(v->s)) ? 0 : !!f;
         }
@@ -116,29 +116,25 @@ UNARY_OP(not) { set_int(v, ~intval(v)); }
         } else if (is_null(l) ^ is_null(r)) {               \
             set_int(l, !(0 op 0));                          \
         } else if (is_str(l) && is_str(r)) {                \
-            set_int(l, ((l->s) op (r->s)));                 \
+            set_int(l, (riff_str_eq(l->s, r->s) op 1));     \
         } else if (is_str(l) && !is_str(r)) {               \
             if (!riff_strlen(l->s)) {                       \
                 set_int(l, !(0 op 0));                      \
                 return;                                     \
             }                                               \
-            char *end;                                      \
-            riff_float f = riff_strtod(l->s->str, &end, 0); \
-            if (*end)                                       \
+            if (!(riff_str_num(l->s) & RIFF_STR_HINT_NUMERIC)) \
                 set_int(l, 0);                              \
             else                                            \
-                set_int(l, (f op numval(r)));               \
+                set_int(l, (str2flt(l->s) op numval(r)));   \
         } else if (!is_str(l) && is_str(r)) {               \
             if (!riff_strlen(r->s)) {                       \
                 set_int(l, !(0 op 0));                      \
                 return;                                     \
             }                                               \
-            char *end;                                      \
-            riff_float f = riff_strtod(r->s->str, &end, 0); \
-            if (*end)                                       \
+            if (!(riff_str_num(r->s) & RIFF_STR_HINT_NUMERIC)) \
                 set_int(l, 0);                              \
             else                                            \
-                set_int(l, (numval(l) op f));               \
+                set_int(l, (numval(l) op str2flt(r->s)));   \
         } else {                                            \
             NUM_ARITH(l,r,op);                              \
         }                                                   \
@@ -166,21 +162,17 @@ UNARY_OP(len) {
     riff_int l = 0;
     switch (v->type) {
 
-    // For integers:
-    //   #x = ⌊log10(x)⌋  + 1 for x > 0
-    //        ⌊log10(-x)⌋ + 2 for x < 0
-    case TYPE_INT:
-        if (v->i == INT64_MIN) {
-            l = 20;
-        } else {
-            l = v->i > 0 ? (riff_int) log10(v->i)  + 1 :
-                v->i < 0 ? (riff_int) log10(-v->i) + 2 : 1;
-        }
-        v->i = l;
+    // Numbers: length of the string representation
+    case TYPE_INT: {
+        char temp[32];
+        v->i = (riff_int) riff_lltostr(v->i, temp);
         return;
-    case TYPE_FLOAT:
-        l = (riff_int) snprintf(NULL, 0, "%g", v->f);
+    }
+    case TYPE_FLOAT: {
+        char temp[32];
+        l = (riff_int) riff_dtostr(v->f, temp);
         break;
+    }
     case TYPE_STR: l = riff_strlen(v->s); break;
     case TYPE_TAB: l = riff_tab_logical_size(v->t); break;
     case TYPE_REGEX: // TODO - extract something from PCRE pattern?
@@ -198,22 +190,42 @@ BINARY_OP(cat) {
     char lbuf[STR_BUF_SZ];
     char rbuf[STR_BUF_SZ];
     char *ls = lbuf, *rs = rbuf;
-    size_t llen = riff_tostr(l, &ls);
     size_t rlen = riff_tostr(r, &rs);
+    // Keep extending a string being built with `#=`
+    if (is_str(l) && riff_str_view(l->s)) {
+        set_str(l, riff_str_append(l->s, rs, rlen));
+        return;
+    }
+    size_t llen = riff_tostr(l, &ls);
     set_str(l, riff_strcat(ls, rs, llen, rlen));
 }
 
+BINARY_OP(catx) {
+    char rbuf[STR_BUF_SZ];
+    char *rs = rbuf;
+    size_t rlen = riff_tostr(r, &rs);
+    if (riff_unlikely(!is_str(l))) {
+        char lbuf[STR_BUF_SZ];
+        char *ls = lbuf;
+        size_t llen = riff_tostr(l, &ls);
+        set_str(l, riff_str_new_tmp(ls, llen));
+    }
+    set_str(l, riff_str_append(l->s, rs, rlen));
+}
+
 static inline void riff_op_catn(vm_stack *fp, int n) {
-    char buf[STR_BUF_SZ];
+    // Reused across calls
+    static riff_buf buf;
+    buf.n = 0;
     char tbuf[STR_BUF_SZ];
-    size_t len = 0;
     for (int i = -n; i <= -1; ++i) {
         char *p = tbuf;
         size_t tlen = riff_tostr(&fp[i].v, &p);
-        memcpy(buf + len, p, tlen);
-        len += tlen;
+        riff_buf_reserve(&buf, tlen);
+        memcpy(buf.list + buf.n, p, tlen);
+        buf.n += tlen;
     }
-    set_str(&fp[-n].v, riff_str_new(buf, len));
+    set_str(&fp[-n].v, riff_str_new_tmp(buf.list, buf.n));
 }
 
 static inline riff_int match(riff_val *l, riff_val *r) {
@@ -237,30 +249,28 @@ static inline riff_int match(riff_val *l, riff_val *r) {
     }
     if (!is_regex(r)) {
         riff_regex *temp_re;
-        riff_int res;
         int errcode;
         int capture = 0;
+        size_t rlen = 0;
         switch (r->type) {
-        case TYPE_INT:   riff_lltostr(r->i, temp_rhs); break;
-        case TYPE_FLOAT: riff_dtostr(r->f, temp_rhs);  break;
+        case TYPE_INT:   rlen = riff_lltostr(r->i, temp_rhs); break;
+        case TYPE_FLOAT: rlen = riff_dtostr(r->f, temp_rhs);  break;
         case TYPE_STR:
             capture = 1;
-            temp_re = re_compile(r->s->str, riff_strlen(r->s), 0, &errcode);
+            temp_re = re_compile_cached(r->s->str, riff_strlen(r->s), 0, &errcode);
             goto do_match;
         default: temp_rhs[0] = '\0'; break;
         }
-        temp_re = re_compile(temp_rhs, PCRE2_ZERO_TERMINATED, 0, &errcode);
+        temp_re = re_compile_cached(temp_rhs, rlen, 0, &errcode);
 do_match:
         // Check for invalid regex in RHS
         // TODO treat as literal string in this case? (PCRE2_LITERAL)
-        if (riff_unlikely(errcode != 100)) {
+        if (riff_unlikely(temp_re == NULL)) {
             PCRE2_UCHAR errstr[0x200];
             pcre2_get_error_message(errcode, errstr, 0x200);
             err((const char *) errstr);
         }
-        res = re_match(lhs, len, temp_re, capture);
-        re_free(temp_re);
-        return res;
+        return re_match(lhs, len, temp_re, capture);
     } else {
         return re_match(lhs, len, r->r, 1);
     }
@@ -305,7 +315,7 @@ BINARY_OP(idx) {
         break;
     }
     case TYPE_NULL:
-        *l = *v_newtab(0);
+        v_newtab(l, 0);
         // Fall-through
     case TYPE_TAB:
         *l = *riff_tab_lookup(l->t, r);
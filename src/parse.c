@@ -611,9 +611,16 @@ static int led(riff_parser *y, uint32_t flags, int p, int tk) {
             if (!is_asgmt(tk)) {
                 set(ox);
             }
+            // For plain assignment, note the LHS address push and the start
+            // of the RHS so codegen can store to variables directly
+            int lhs = tk == '=' ? y->c->last : -1;
+            int rhs = y->c->n;
             advance();
             p = expr(y, flags & ~EXPR_REF, lbop(tk) ? lbp(tk) : lbp(tk) - 1);
-            c_infix(y->c, tk);
+            if (tk == '=')
+                c_assign(y->c, lhs, rhs);
+            else
+                c_infix(y->c, tk);
         }
         break;
     }
@@ -714,7 +721,7 @@ static void do_stmt(riff_parser *y) {
     uint8_t old_loop = y->loop;
     y->loop = ++y->ld;
     enter_loop(y, &b, &c);
-    int l1 = y->c->n;
+    int l1 = c_label(y->c);
     if (TK_CMP(0, '{')) {
         advance();
         stmt_list(y);
@@ -739,8 +746,13 @@ static void do_stmt(riff_parser *y) {
     // Patch continue stmts
     patch_jumps(y, &c);
 
+    // A constant condition either always or never repeats the loop
     expr(y, 0, 0);
-    c_jump(y->c, jmp, l1);
+    int cond = c_fold_test(y->c);
+    if (cond < 0)
+        c_jump(y->c, jmp, l1);
+    else if (cond == (jmp == JNZ))
+        c_jump(y->c, JMP, l1);
 
     // Patch break stmts
     patch_jumps(y, &b);
@@ -951,13 +963,41 @@ static void for_stmt(riff_parser *y) {
     exit_loop(y, r_brk, r_cont, &b, &c);
 }
 
+// Code generated between dead_begin() and dead_end() is discarded, along with
+// any break/continue jumps it reserved in the enclosing loop.
+typedef struct {
+    int    n;
+    size_t brk, cont;
+} dead_code;
+
+static void dead_begin(riff_parser *y, dead_code *d) {
+    d->n    = y->c->n;
+    d->brk  = y->brk  ? y->brk->n  : 0;
+    d->cont = y->cont ? y->cont->n : 0;
+}
+
+static void dead_end(riff_parser *y, dead_code *d) {
+    c_discard(y->c, d->n);
+    if (y->brk)
+        y->brk->n = d->brk;
+    if (y->cont)
+        y->cont->n = d->cont;
+}
+
 // if_stmt = 'if' expr stmt {'elif' expr ...} ['else' ...]
 //         | 'if' expr '{' stmt_list '}' {'elif' expr ...} ['else' ...]
+//
+// When the condition folds to a constant, only the branch taken is kept.
 static void if_stmt(riff_parser *y) {
     expr(y, 0, 0);
-    int l1, l2;
+    int l1, l2 = 0;
+    int cond = c_fold_test(y->c);
+    dead_code d = {0};
     ++y->ld;
-    l1 = c_prep_jump(y->c, JZ);
+    if (cond < 0)
+        l1 = c_prep_jump(y->c, JZ);
+    else if (!cond)
+        dead_begin(y, &d);
     if (TK_CMP(0, '{')) {
         advance();
         stmt_list(y);
@@ -967,13 +1007,23 @@ static void if_stmt(riff_parser *y) {
     }
     --y->ld;
     y->locals.n -= pop_locals(y, y->ld, 1);
+    if (!cond)
+        dead_end(y, &d);
     if (TK_CMP(0, RIFF_TK_ELIF)) {
 y_elif:
         advance();
-        l2 = c_prep_jump(y->c, JMP);
-        c_patch(y->c, l1);
-        if_stmt(y);
-        c_patch(y->c, l2);
+        if (cond < 0) {
+            l2 = c_prep_jump(y->c, JMP);
+            c_patch(y->c, l1);
+            if_stmt(y);
+            c_patch(y->c, l2);
+        } else if (cond) {
+            dead_begin(y, &d);
+            if_stmt(y);
+            dead_end(y, &d);
+        } else {
+            if_stmt(y);
+        }
     } else if (TK_CMP(0, RIFF_TK_ELSE)) {
         advance();
         // Handle as `elif` for `else if`. This avoids the non-breaking issue
@@ -982,8 +1032,12 @@ y_elif:
             goto y_elif;
         }
         ++y->ld;
-        l2 = c_prep_jump(y->c, JMP);
-        c_patch(y->c, l1);
+        if (cond < 0) {
+            l2 = c_prep_jump(y->c, JMP);
+            c_patch(y->c, l1);
+        } else if (cond) {
+            dead_begin(y, &d);
+        }
         if (TK_CMP(0, '{')) {
             advance();
             stmt_list(y);
@@ -991,10 +1045,13 @@ y_elif:
         } else {
             stmt(y);
         }
-        c_patch(y->c, l2);
+        if (cond < 0)
+            c_patch(y->c, l2);
         --y->ld;
         y->locals.n -= pop_locals(y, y->ld, 1);
-    } else {
+        if (cond > 0)
+            dead_end(y, &d);
+    } else if (cond < 0) {
         c_patch(y->c, l1);
     }
 }
@@ -1048,7 +1105,7 @@ static void loop_stmt(riff_parser *y) {
     uint8_t old_loop = y->loop;
     y->loop = ++y->ld;
     enter_loop(y, &b, &c);
-    int l1 = y->c->n;
+    int l1 = c_label(y->c);
     if (TK_CMP(0, '{')) {
         advance();
         stmt_list(y);
@@ -1094,14 +1151,20 @@ static void return_stmt(riff_parser *y) {
     c_return(y->c, p != y->x->p);
 }
 
+// A condition folding to a constant either drops the test (the loop runs until
+// a break) or discards the loop entirely.
 static void conditional_loop(riff_parser *y, enum riff_code_jump jmp) {
     patch_list *r_brk  = y->brk;
     patch_list *r_cont = y->cont;
     patch_list b, c;
-    int l1, l2;
-    l1 = y->c->n;
+    int l1, l2 = 0;
+    l1 = c_label(y->c);
     expr(y, 0, 0);
-    l2 = c_prep_jump(y->c, jmp);
+    int cond = c_fold_test(y->c);
+    if (cond < 0)
+        l2 = c_prep_jump(y->c, jmp);
+    else if (jmp == JNZ)
+        cond = !cond;
     uint8_t old_loop = y->loop;
     y->loop = ++y->ld;
     enter_loop(y, &b, &c);
@@ -1120,11 +1183,14 @@ static void conditional_loop(riff_parser *y, enum riff_code_jump jmp) {
     patch_jumps(y, &c);
 
     c_jump(y->c, JMP, l1);
-    c_patch(y->c, l2);
+    if (cond < 0)
+        c_patch(y->c, l2);
 
     // Patch break stmts
     patch_jumps(y, &b);
     exit_loop(y, r_brk, r_cont, &b, &c);
+    if (!cond)
+        c_discard(y->c, l1);
 }
 
 // until_stmt = 'until' expr stmt
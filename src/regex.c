@@ -1,14 +1,53 @@
+// memmem()
+#define _GNU_SOURCE
+
 #include "value.h"
 
 #include "conf.h"
 #include "string.h"
 #include "table.h"
 
+#include <ctype.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include <string.h>
 
 static riff_tab *fldv;
 static pcre2_compile_context *context = NULL;
+static pcre2_match_context   *mcontext = NULL;
+
+// Match data block shared by all match operations, grown to fit the pattern
+// with the most capture groups seen so far
+static pcre2_match_data *mdata = NULL;
+static uint32_t          mdata_pairs = 0;
+
+// LRU cache of regexes compiled from strings at runtime (e.g. `s ~ "a+"`),
+// most recently used first. Entries are keyed on the pattern's contents
+// rather than the riff_str's address, since transient strings aren't
+// interned and the collector may reuse the address of a dead string.
+typedef struct {
+    char       *pattern;
+    size_t      len;
+    uint32_t    flags;
+    uint32_t    hits;
+    riff_regex *re;
+} re_cache_entry;
+
+static re_cache_entry cache[RE_CACHE_SIZE];
+static int            cache_n = 0;
+
+// Captures of the last successful match not yet stored in the fields table
+// (see re_store_numbered_captures())
+static struct {
+    uint32_t    n;        // Number of pending captures
+    uint32_t    ovec_cap;
+    PCRE2_SIZE *ovec;     // Capture offsets into `buf`
+    size_t      cap;
+    char       *buf;      // Copy of the subject span covering all captures
+} pending;
+
+// Bound on the integer keys of the fields table stored by store_captures()
+static uint32_t stored_n = 0;
 
 // Register the VM's global fields table
 void re_register_fldv(riff_tab *t) {
@@ -16,64 +55,397 @@ void re_register_fldv(riff_tab *t) {
     return;
 }
 
+// Extract the longest run of literal bytes every match of the pattern must
+// contain, allowing re_exec() to skip PCRE2 entirely for subjects lacking it.
+// Only literals at the top level of the pattern are considered, and the
+// analysis gives up on constructs that change how later bytes are matched
+// (e.g. inline options, `\Q...\E`, top-level alternation). If the pattern
+// consists of nothing but the literal, it is marked RE_LIT_PURE and
+// re_match() doesn't call PCRE2 at all.
+static void analyze(riff_regex *r, const char *p, size_t len, uint32_t flags) {
+    r->lit_type = 0;
+    r->lit_len = 0;
+    r->lit = NULL;
+    if (flags & (RE_ICASE | RE_EXTENDED | RE_EXTENDED_MORE))
+        return;
+    if (flags & RE_LITERAL) {
+        if (len) {
+            r->lit = malloc(len);
+            memcpy(r->lit, p, len);
+            r->lit_len = len;
+            r->lit_type = RE_LIT_PURE | (flags & RE_ANCHORED ? RE_LIT_ANCHORED : 0);
+        }
+        return;
+    }
+    char  *cur = malloc(len + 1), *best = malloc(len + 1);
+    size_t n = 0, best_n = 0;
+    size_t i = 0;
+    int depth = 0, pure = 1, prev_lit = 0, esc_args = 0;
+    int anchored = !!(flags & RE_ANCHORED);
+    if (len && p[0] == '^' && !(flags & RE_MULTILINE)) {
+        anchored = 1;
+        ++i;
+    }
+
+#define end_run() do { \
+        if (n > best_n) { \
+            char *t = best; best = cur; cur = t; \
+            best_n = n; \
+        } \
+        n = 0; \
+    } while (0)
+
+    while (i < len) {
+        unsigned char c = p[i++];
+        int lit = 0;
+
+        // Arguments of escapes like \x{..}, \p{..} or \g<..> are never
+        // literals
+        if (esc_args) {
+            if (isalnum(c) || strchr("{}<>'+-,_", c)) {
+                prev_lit = 0;
+                continue;
+            }
+            esc_args = 0;
+        }
+        switch (c) {
+        case '\\':
+            if (i == len)
+                goto fail;
+            c = p[i++];
+            if (c >= 0x80) {
+                pure = 0;
+                end_run();
+            } else if (isalnum(c)) {
+                if (c == 'Q' || c == 'E')
+                    goto fail;
+                pure = 0;
+                esc_args = 1;
+                end_run();
+            } else {
+                lit = 1;
+            }
+            break;
+        case '[':
+            pure = 0;
+            end_run();
+            if (i < len && p[i] == '^') ++i;
+            if (i < len && p[i] == ']') ++i;
+            while (i < len && p[i] != ']') {
+                if (p[i] == '\\')
+                    ++i;
+                else if (p[i] == '[' && i + 1 < len && p[i+1] == ':')
+                    while (++i < len && !(p[i-1] == ':' && p[i] == ']'));
+                ++i;
+            }
+            ++i;
+            break;
+        case '(':
+            // Inline options, comments and verbs such as (*ACCEPT) affect
+            // the meaning of the rest of the pattern
+            if (i < len && p[i] == '*')
+                goto fail;
+            if (i < len && p[i] == '?' && i + 1 < len &&
+                    !strchr(":=!<>|P'&(R+0123456789", p[i+1]))
+                goto fail;
+            ++depth;
+            pure = 0;
+            end_run();
+            break;
+        case ')':
+            --depth;
+            end_run();
+            break;
+        case '|':
+            if (!depth)
+                goto fail;
+            break;
+        case '?': case '*': case '{':
+            // Quantifiers allowing zero repetitions make the preceding byte
+            // optional
+            if (prev_lit)
+                --n;
+            pure = 0;
+            end_run();
+            if (c == '{') {
+                while (i < len && strchr("0123456789,", p[i]))
+                    ++i;
+                if (i < len && p[i] == '}')
+                    ++i;
+            }
+            break;
+        case '+': case '.': case '^': case '$':
+            pure = 0;
+            end_run();
+            break;
+        default:
+            if (c >= 0x80) {
+                pure = 0;
+                end_run();
+            } else {
+                lit = 1;
+            }
+            break;
+        }
+        if (lit && !depth)
+            cur[n++] = c;
+        else if (lit)
+            pure = 0;
+        prev_lit = lit && !depth;
+    }
+    if (pure) {
+        r->lit_type = RE_LIT_PURE | (anchored ? RE_LIT_ANCHORED : 0);
+    } else {
+        end_run();
+        n = best_n;
+        if (n < RE_LIT_MIN)
+            goto fail;
+        char *t = best; best = cur; cur = t;
+    }
+    if (!n)
+        goto fail;
+    r->lit = realloc(cur, n);
+    r->lit_len = n;
+    free(best);
+    return;
+fail:
+    r->lit_type = 0;
+    free(cur);
+    free(best);
+    return;
+
+#undef end_run
+}
+
 riff_regex *re_compile(char *pattern, size_t len, uint32_t flags, int *errcode) {
     if (context == NULL) {
         context = pcre2_compile_context_create(NULL);
         pcre2_set_compile_extra_options(context, RE_CFLAGS_EXTRA);
+        mcontext = pcre2_match_context_create(NULL);
+#ifdef RE_JIT
+        pcre2_jit_stack *stack = pcre2_jit_stack_create(RE_JIT_STACK_MIN, RE_JIT_STACK_MAX, NULL);
+        pcre2_jit_stack_assign(mcontext, NULL, stack);
+#endif
     }
 
     PCRE2_SIZE erroffset;
-    riff_regex *r = pcre2_compile(
+    pcre2_code *code = pcre2_compile(
             (PCRE2_SPTR) pattern,   // Raw pattern string
             len,                    // Length (or specify zero terminated)
             flags | RE_CFLAGS,      // Options/flags
             errcode,                // Error code
             &erroffset,             // Error offset
             context);               // Compile context
+    if (code == NULL)
+        return NULL;
+    riff_regex *r = malloc(sizeof *r);
+    r->code = code;
+    pcre2_pattern_info(code, PCRE2_INFO_CAPTURECOUNT, &r->ncap);
+    if (len == PCRE2_ZERO_TERMINATED)
+        len = strlen(pattern);
+    analyze(r, pattern, len, flags);
     return r;
 }
 
+// Returns the compiled regex for a pattern string, compiling and caching it
+// on a miss. The result is owned by the cache and only valid until the next
+// call, so it must not be freed or retained. Returns NULL and sets `errcode`
+// if the pattern fails to compile.
+riff_regex *re_compile_cached(const char *pattern, size_t len, uint32_t flags, int *errcode) {
+    re_cache_entry e;
+    int i;
+    for (i = 0; i < cache_n; ++i) {
+        if (cache[i].len == len && cache[i].flags == flags &&
+                !memcmp(cache[i].pattern, pattern, len))
+            break;
+    }
+    if (i < cache_n) {
+        e = cache[i];
+
+        // JIT-compile patterns once they're seen to be reused
+        if (e.hits++ == 0)
+            re_jit_compile(e.re);
+    } else {
+        e.re = re_compile((char *) pattern, len, flags, errcode);
+        if (riff_unlikely(e.re == NULL))
+            return NULL;
+        e.pattern = malloc(len);
+        memcpy(e.pattern, pattern, len);
+        e.len = len;
+        e.flags = flags;
+        e.hits = 0;
+
+        // Evict the least recently used entry
+        if (cache_n == RE_CACHE_SIZE) {
+            re_free(cache[--cache_n].re);
+            free(cache[cache_n].pattern);
+        }
+        i = cache_n++;
+    }
+    memmove(cache + 1, cache, i * sizeof *cache);
+    cache[0] = e;
+    return e.re;
+}
+
+// JIT-compile a regex that is expected to be matched repeatedly (e.g. regex
+// literals). Failure is harmless; re_exec() falls back to the interpreter.
+void re_jit_compile(riff_regex *re) {
+#ifdef RE_JIT
+    // pcre2_jit_match() skips the UTF validity check on the subject, so
+    // patterns enabling UTF mode (e.g. `(*UTF)`) are left interpreted
+    uint32_t opts;
+    pcre2_pattern_info(re->code, PCRE2_INFO_ALLOPTIONS, &opts);
+    if (!(opts & PCRE2_UTF))
+        pcre2_jit_compile(re->code, PCRE2_JIT_COMPLETE);
+#endif
+    return;
+}
+
 void re_free(riff_regex *re) {
-    pcre2_code_free(re);
+    pcre2_code_free(re->code);
+    free(re->lit);
+    free(re);
     return;
 }
 
-int re_store_numbered_captures(pcre2_match_data *md) {
-    uint32_t i = 0;
-    PCRE2_UCHAR buf[STR_BUF_SZ];
-    while (1) {
-        PCRE2_SIZE l = STR_BUF_SZ;
-        if (!pcre2_substring_copy_bynumber(md, i, buf, &l)) {
-            riff_val v = (riff_val) {TYPE_STR, .s = riff_str_new((const char *) buf, l)};
-            riff_tab_insert_int(fldv, (riff_int) i, &v);
-        } else {
-            break;
-        }
-        ++i;
+// Materialize pending captures into the fields table
+static void store_captures(void) {
+    for (uint32_t i = 0; i < pending.n; ++i) {
+        PCRE2_SIZE l = pending.ovec[2*i], r = pending.ovec[2*i+1];
+        riff_val v = (riff_val) {TYPE_STR, .s = riff_str_new(pending.buf + l, l > r ? 0 : r - l)};
+        riff_tab_insert_int(fldv, (riff_int) i, &v);
+    }
+    if (pending.n > stored_n)
+        stored_n = pending.n;
+    pending.n = 0;
+}
+
+void re_flush_captures(void) {
+    if (pending.n)
+        store_captures();
+    return;
+}
+
+// Record `n` captures with the given offsets into subject `s`
+static void set_pending(const char *s, PCRE2_SIZE *ov, uint32_t n) {
+
+    // Captures not overwritten by this match keep the values of the
+    // pending match
+    if (pending.n > n)
+        store_captures();
+    if (n > pending.ovec_cap) {
+        pending.ovec = realloc(pending.ovec, 2 * n * sizeof *pending.ovec);
+        pending.ovec_cap = n;
+    }
+    PCRE2_SIZE lo = ov[0], hi = ov[1];
+    for (uint32_t i = 0; i < 2 * n; ++i) {
+        if (ov[i] < lo) lo = ov[i];
+        if (ov[i] > hi) hi = ov[i];
     }
+    if (hi - lo >= pending.cap) {
+        pending.cap = hi - lo + 1;
+        pending.buf = realloc(pending.buf, pending.cap);
+    }
+    memcpy(pending.buf, s + lo, hi - lo);
+    for (uint32_t i = 0; i < 2 * n; ++i)
+        pending.ovec[i] = ov[i] - lo;
+    pending.n = n;
+}
+
+// Replace the contents of the fields table with record `s` ($0) and its
+// fields ($1, $2, etc.), given as `n` pairs of offsets into `s`. Like
+// captures, the strings are only created once the fields table is accessed.
+// Fields left over from a longer record or an earlier match are cleared.
+void re_set_record(const char *s, PCRE2_SIZE *ov, uint32_t n) {
+    pending.n = 0;
+    for (uint32_t i = n; i < stored_n; ++i)
+        riff_tab_insert_int(fldv, (riff_int) i, &(riff_val) {TYPE_NULL});
+    stored_n = n;
+    set_pending(s, ov, n);
+}
+
+// Note an assignment to field `i` by the program, so the next record clears
+// it along with any fields stored by earlier captures
+void re_touch_field(riff_int i) {
+    if (i >= 0 && i < UINT32_MAX && (uint32_t) i >= stored_n)
+        stored_n = (uint32_t) i + 1;
+    return;
+}
+
+// Record the numbered captures of the last match on subject `s` to be stored
+// in the fields table on the next access. Only the span of the subject
+// covering the captures is copied; most scripts testing for a match never
+// read the captures.
+int re_store_numbered_captures(pcre2_match_data *md, const char *s) {
+    PCRE2_SIZE l;
+    uint32_t n = 0;
+
+    // Captures are stored up to the first unset group
+    while (!pcre2_substring_length_bynumber(md, n, &l))
+        ++n;
+    if (n)
+        set_pending(s, pcre2_get_ovector_pointer(md), n);
     return 0;
 }
 
+// Match context carrying the JIT stack, for passing to PCRE2 functions
+// which match internally (e.g. pcre2_substitute())
+pcre2_match_context *re_match_context(void) {
+    return mcontext;
+}
+
+// Returns the shared match data block, with room for every capture group in
+// `re`. Its contents are only valid until the next regex operation.
+pcre2_match_data *re_match_data(riff_regex *re) {
+    uint32_t n = re->ncap + 1;
+    if (riff_unlikely(n > mdata_pairs)) {
+        pcre2_match_data_free(mdata);
+        mdata = pcre2_match_data_create(n, NULL);
+        mdata_pairs = n;
+    }
+    return mdata;
+}
+
+// Match `re` against `s` starting at offset `off`, using the JIT-compiled
+// code if available. Patterns that weren't JIT-compiled, or that exhaust the
+// JIT stack, are matched by the interpreter instead. Subjects lacking the
+// pattern's required literal are rejected without calling PCRE2.
+int re_exec(riff_regex *re, const char *s, size_t len, size_t off, pcre2_match_data *md) {
+    if (re->lit && !memmem(s + off, len - off, re->lit, re->lit_len))
+        return PCRE2_ERROR_NOMATCH;
+#ifdef RE_JIT
+    int rc = pcre2_jit_match(re->code, (PCRE2_SPTR) s, len, off, 0, md, mcontext);
+    if (riff_likely(rc != PCRE2_ERROR_JIT_BADOPTION && rc != PCRE2_ERROR_JIT_STACKLIMIT))
+        return rc;
+#endif
+    return pcre2_match(re->code, (PCRE2_SPTR) s, len, off, RE_NO_JIT, md, mcontext);
+}
+
 riff_int re_match(char *s, size_t len, riff_regex *re, int capture) {
 
-    // Create PCRE2 match data block
-    pcre2_match_data *md = pcre2_match_data_create_from_pattern(re, NULL);
+    // Pure literals are searched for directly
+    if (re->lit_type & RE_LIT_PURE) {
+        const char *m;
+        if (re->lit_type & RE_LIT_ANCHORED)
+            m = len >= re->lit_len && !memcmp(s, re->lit, re->lit_len) ? s : NULL;
+        else
+            m = memmem(s, len, re->lit, re->lit_len);
+        if (m == NULL)
+            return 0;
+        if (capture) {
+            PCRE2_SIZE ov[2] = {m - s, m - s + re->lit_len};
+            set_pending(s, ov, 1);
+        }
+        return 1;
+    }
+    pcre2_match_data *md = re_match_data(re);
 
     // Perform match
-    int rc = pcre2_match(
-            re,                     // Compiled regex
-            (PCRE2_SPTR) s,         // String to match against
-            len,                    // Length (or specify zero terminated)
-            0,                      // Start offset
-            0,                      // Options/flags
-            md,                     // Match data block
-            NULL);                  // Match context
-
-    // Insert captured substrings into the VM's field vector
-    if (capture)
-        re_store_numbered_captures(md);
+    int rc = re_exec(re, s, len, 0, md);
 
-    // Free the PCRE2 match data
-    pcre2_match_data_free(md);
+    // Record captured substrings for the VM's field vector. The match data
+    // is stale if the match was ruled out before calling PCRE2.
+    if (capture && rc > 0)
+        re_store_numbered_captures(md, s);
     return (riff_int) (rc > 0);
 }
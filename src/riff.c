@@ -1,6 +1,8 @@
 #include "buf.h"
 #include "code.h"
 #include "disas.h"
+#include "jit.h"
+#include "lib.h"
 #include "mem.h"
 #include "parse.h"
 #include "state.h"
@@ -30,10 +32,12 @@ int riff_main(int flag, char *str) {
     global_state.src = str,
 
     riff_compile(&global_state);
-    if (flag)
+    if (flag) {
         riff_exec(&global_state);
-    else
+        riff_out_flush();
+    } else {
         riff_disas(&global_state);
+    }
     return 0;
 }
 
@@ -47,8 +51,13 @@ static void usage(void) {
     puts("usage: riff [options] program [argument ...]\n"
          "Available options:\n"
          "  -e prog  execute string 'prog'\n"
+         "  -F sep   split records on 'sep' (implies -n)\n"
          "  -h       print this usage text and exit\n"
+         "  -j       compile hot code to native code (x86-64 Linux)\n"
          "  -l       list bytecode with assembler-like mnemonics\n"
+         "  -n       run the program once per input line\n"
+         "  -p       as -n, printing $0 after each line\n"
+         "  -u       write output to stdout unbuffered\n"
          "  -v       print version information and exit\n"
          "  --       stop processing options\n"
          "  -        stop processing options and execute stdin");
@@ -117,26 +126,44 @@ int main(int argc, char **argv) {
 
     opterr = 0;
     int o;
-    while ((o = getopt(argc, argv, "e:hlv")) != -1) {
+    while ((o = getopt(argc, argv, "e:F:hjlnpuv")) != -1) {
         switch (o) {
         case 'e':
             opt_e = true;
             global_state.src = optarg;
             riff_compile(&global_state);
             break;
+        case 'F':
+            global_state.rec_fs = strcmp(optarg, "\\t") ? optarg : "\t";
+            if (global_state.rec_mode == REC_NONE)
+                global_state.rec_mode = REC_LOOP;
+            break;
         case 'h':
             usage();
             exit(0);
+        case 'j':
+            riff_jit_enabled = 1;
+            break;
         case 'l':
             global_state.disas = true;
             interpret = riff_disas;
             break;
+        case 'n':
+            if (global_state.rec_mode == REC_NONE)
+                global_state.rec_mode = REC_LOOP;
+            break;
+        case 'p':
+            global_state.rec_mode = REC_PRINT;
+            break;
+        case 'u':
+            riff_out_unbuffered = 1;
+            break;
         case 'v':
             version();
             exit(0);
         case '?':
-            if (optopt == 'e')
-                printf("riff: missing argument for option '-e'\n");
+            if (optopt == 'e' || optopt == 'F')
+                printf("riff: missing argument for option '-%c'\n", optopt);
             else
                 printf("riff: unrecognized option: '-%c'\n", optopt);
             usage();
@@ -154,7 +181,13 @@ int main(int argc, char **argv) {
         }
         global_state.src = stdin2str();
         global_state.name = "<stdin>";
+        global_state.rec_argi = argc;
         riff_compile(&global_state);
+    } else if (optind < argc && opt_e && global_state.rec_mode) {
+        // Remaining arguments are input files
+        global_state.name = "<command-line>";
+        global_state.arg0 = optind;
+        global_state.rec_argi = optind;
     } else if (optind < argc) {
         // Option '-': Stop processing options and execute stdin
         if (argv[optind][0] == '-' && argv[optind][1] != '-') {
@@ -165,9 +198,11 @@ int main(int argc, char **argv) {
             global_state.name = argv[optind];
         }
         global_state.arg0 = optind;
+        global_state.rec_argi = optind + 1;
         riff_compile(&global_state);
     } else {
         global_state.name = "<command-line>";
+        global_state.rec_argi = argc;
     }
 
     interpret(&global_state);
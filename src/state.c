@@ -8,6 +8,9 @@ void riff_state_init(riff_state *s) {
         .arg0  = 0,
         .argv  = NULL,
         .disas = false,
+        .rec_mode = REC_NONE,
+        .rec_argi = 0,
+        .rec_fs   = NULL,
     };
     riff_fn_init(&s->main);
     riff_vec_init(&s->global_fn);
@@ -7,6 +7,13 @@
 
 #include <stdbool.h>
 
+// Record processing modes (-n/-p)
+enum riff_rec_mode {
+    REC_NONE,
+    REC_LOOP,   // Run the program once per input record
+    REC_PRINT,  // As above, printing $0 after each record
+};
+
 typedef struct {
     const char           *name;
     const char           *src;
@@ -17,6 +24,9 @@ typedef struct {
     RIFF_VEC(riff_fn *)   global_fn;
     RIFF_VEC(riff_fn *)   anon_fn;
     bool                  disas;
+    int                   rec_mode;
+    int                   rec_argi; // Index in argv of the first input file
+    const char           *rec_fs;   // Field separator (-F)
 } riff_state;
 
 void riff_state_init(riff_state *);
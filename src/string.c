@@ -1,5 +1,7 @@
 #include "string.h"
 
+#include "gc.h"
+
 #include <ctype.h>
 #include <inttypes.h>
 #include <math.h>
@@ -8,13 +10,24 @@
 #include <string.h>
 
 #define ST_MIN_CAP 8
+#define ST_MIN_LOAD_FACTOR 0.25
 #define ST_MAX_LOAD_FACTOR 1.0
 
+// NOTE: Interning is weak; strings nothing references are freed by the
+// garbage collector. The table is swept incrementally bucket by bucket,
+// `sweep` being the index of the next bucket to sweep (`cap` when no sweep
+// is in progress). Transient strings are kept in a separate list, swept after
+// the buckets, followed by the buffers backing string views.
 typedef struct {
     riff_str **nodes;
     uint32_t   size;
     uint32_t   mask;
     uint32_t   cap;
+    uint32_t   sweep;
+    riff_str  *tmp;
+    riff_str  *tmpsweep;
+    riff_strbuf *bufs;
+    riff_strbuf *bufsweep;
     riff_str  *empty;
 } riff_stab;
 
@@ -26,11 +39,18 @@ void riff_stab_init(void) {
     st->size  = 0;
     st->mask  = ST_MIN_CAP - 1;
     st->cap   = ST_MIN_CAP;
+    st->sweep = ST_MIN_CAP;
+    st->tmp   = NULL;
+    st->tmpsweep = NULL;
+    st->bufs  = NULL;
+    st->bufsweep = NULL;
     riff_str *e = malloc(sizeof(riff_str));
     *e = (riff_str) {
         .hash  = 0,
         .hints = 0,
         .extra = 0,
+        .flags = 0,
+        .mark  = 0,
         .len   = 0,
         .str   = "",
         .next  = NULL
@@ -75,6 +95,32 @@ static inline uint8_t str_hints(const char *str, size_t len) {
     return flags;
 }
 
+void riff_str_init_hints(riff_str *s) {
+    s->hints = str_hints(s->str, riff_strlen(s));
+}
+
+void riff_str_init_num(riff_str *s) {
+    uint8_t hints = riff_str_hints(s) | RIFF_STR_HINT_NUM;
+    const char *str = riff_str_cstr(s);
+    char *end;
+    riff_float f = riff_strtod(str, &end, 0);
+    if (!*end) {
+        hints |= RIFF_STR_HINT_NUMERIC;
+        riff_int i = riff_strtoll(str, &end, 0);
+        riff_float fi = (riff_float) i;
+        // Compare representations so "-0" stays a float
+        if (!*end && !memcmp(&fi, &f, sizeof f)) {
+            hints |= RIFF_STR_HINT_INT;
+            s->num.i = i;
+        } else {
+            s->num.f = f;
+        }
+    } else {
+        s->num.f = f;
+    }
+    s->hints = hints;
+}
+
 static inline riff_str *next(riff_str *s) {
     return s->next;
 }
@@ -97,10 +143,11 @@ static inline void insert_str(riff_str **nodes, riff_str *new, uint32_t i) {
     n->next = new;
 }
 
+// Strings are allocated with their characters inline
 static inline riff_str *new_str(riff_str *s) {
     size_t len = riff_strlen(s);
-    riff_str *new = malloc(sizeof(riff_str));
-    char *str = malloc(len * sizeof(char) + 1);
+    riff_str *new = malloc(sizeof(riff_str) + len + 1);
+    char *str = (char *) (new + 1);
     memcpy(str, s->str, len);
     str[len] = '\0';
     memcpy(new, s, sizeof(riff_str));
@@ -109,7 +156,14 @@ static inline riff_str *new_str(riff_str *s) {
     return new;
 }
 
+static size_t st_sweep(riff_stab *, size_t);
+
 static inline void st_resize(riff_stab *t, size_t new_cap) {
+    // Bucket indexes are meaningless after rehashing; finish any sweep in
+    // progress first
+    if (riff_unlikely(t->sweep < t->cap)) {
+        st_sweep(t, SIZE_MAX);
+    }
     riff_str **new_nodes = calloc(new_cap, sizeof(riff_str *));
     for (uint32_t i = 0; i < t->cap; ++i) {
         riff_str *s = t->nodes[i];
@@ -124,25 +178,125 @@ static inline void st_resize(riff_stab *t, size_t new_cap) {
     t->nodes = new_nodes;
     t->mask = new_cap - 1;
     t->cap = new_cap;
+    t->sweep = new_cap;
+}
+
+// Any string handed out while the collector is marking is considered
+// reachable for the remainder of the cycle, since interning can revive a
+// string the collector hasn't seen yet. Likewise for strings in buckets not
+// yet swept.
+static inline uint8_t st_mark(riff_stab *t, uint32_t i) {
+    return riff_gc_state == GC_STATE_PROPAGATE || i >= t->sweep;
 }
 
 static inline riff_str *st_lookup(riff_stab *t, riff_str *s) {
-    riff_str *n = t->nodes[s->hash & t->mask];
+    uint32_t i = s->hash & t->mask;
+    riff_str *n = t->nodes[i];
     while (n) {
         if (riff_likely(riff_str_eq_raw(n,s))) {
+            n->mark |= st_mark(t, i);
             return n;
         }
         n = next(n);
     }
     if (riff_unlikely(potential_lf(t) > ST_MAX_LOAD_FACTOR)) {
         st_resize(t, t->cap << 1);
+        i = s->hash & t->mask;
     }
     riff_str *new = new_str(s);
-    insert_str(t->nodes, new, s->hash & t->mask);
+    new->mark = st_mark(t, i);
+    insert_str(t->nodes, new, i);
     t->size++;
+    riff_gc_account(sizeof(riff_str) + riff_strlen(s) + 1);
     return new;
 }
 
+// Free unmarked strings and clear the marks of the survivors, bucket by
+// bucket, until the work budget is spent. Strings reserved by the lexer
+// (nonzero `extra`) are never freed. Returns the amount of work performed.
+static size_t st_sweep(riff_stab *t, size_t budget) {
+    size_t work = 0;
+    while (t->sweep < t->cap && work < budget) {
+        riff_str **a = &t->nodes[t->sweep++];
+        riff_str *s = *a;
+        while (s) {
+            if (s->mark || s->extra) {
+                s->mark = 0;
+                a = &s->next;
+            } else {
+                *a = s->next;
+                free(s);
+                t->size--;
+            }
+            s = *a;
+            work += GC_SWEEP_COST;
+        }
+        work += sizeof(riff_str *);
+    }
+    return work;
+}
+
+static size_t st_sweep_tmp(riff_stab *t, size_t budget) {
+    size_t work = 0;
+    while (t->tmpsweep && work < budget) {
+        riff_str *s = t->tmpsweep;
+        t->tmpsweep = s->next;
+        if (s->mark) {
+            s->mark = 0;
+            s->next = t->tmp;
+            t->tmp = s;
+        } else {
+            free(s);
+        }
+        work += GC_SWEEP_COST;
+    }
+    return work;
+}
+
+static size_t st_sweep_bufs(riff_stab *t, size_t budget) {
+    size_t work = 0;
+    while (t->bufsweep && work < budget) {
+        riff_strbuf *b = t->bufsweep;
+        t->bufsweep = b->next;
+        if (b->mark) {
+            b->mark = 0;
+            b->next = t->bufs;
+            t->bufs = b;
+        } else {
+            free(b);
+        }
+        work += GC_SWEEP_COST;
+    }
+    return work;
+}
+
+void riff_stab_sweep_begin(void) {
+    st->sweep = 0;
+    st->tmpsweep = st->tmp;
+    st->tmp = NULL;
+    st->bufsweep = st->bufs;
+    st->bufs = NULL;
+}
+
+// Perform a bounded amount of sweeping, shrinking the bucket array once the
+// sweep completes if the table has become sparse. Returns zero if there's
+// nothing left to sweep.
+size_t riff_stab_sweep(size_t budget) {
+    if (st->sweep >= st->cap)
+        return st->tmpsweep ? st_sweep_tmp(st, budget)
+                            : st_sweep_bufs(st, budget);
+    size_t work = st_sweep(st, budget);
+    if (st->sweep == st->cap) {
+        uint32_t cap = st->cap;
+        while (cap > ST_MIN_CAP && st->size < cap * ST_MIN_LOAD_FACTOR)
+            cap >>= 1;
+        if (cap < st->cap)
+            st_resize(st, cap);
+    }
+    return work;
+}
+
+
 riff_str *riff_str_new_extra(const char *start, size_t len, uint8_t extra) {
     return riff_likely(len)
         ? st_lookup(st,
@@ -150,6 +304,8 @@ riff_str *riff_str_new_extra(const char *start, size_t len, uint8_t extra) {
                 .hash  = str_hash(start, len),
                 .hints = str_hints(start, len),
                 .extra = extra,
+                .flags = 0,
+                .mark  = 0,
                 .len   = len,
                 .str   = (char *) start,
                 .next  = NULL
@@ -163,12 +319,121 @@ riff_str *riff_str_new(const char *start, size_t len) {
     return riff_str_new_extra(start, len, 0);
 }
 
+// Allocate a transient string of `len` bytes, leaving the contents to the
+// caller
+static riff_str *new_tmp(size_t len) {
+    riff_str *s = malloc(sizeof(riff_str) + len + 1);
+    char *str = (char *) (s + 1);
+    str[len] = '\0';
+    *s = (riff_str) {
+        .hash  = 0,
+        .hints = RIFF_STR_HINT_PENDING,
+        .extra = 0,
+        .flags = RIFF_STR_TRANSIENT,
+        .mark  = riff_gc_state == GC_STATE_PROPAGATE,
+        .len   = len,
+        .str   = str,
+        .next  = st->tmp
+    };
+    st->tmp = s;
+    riff_gc_account(sizeof(riff_str) + len + 1);
+    return s;
+}
+
+// Create a transient string; no hashing or interning is done until the
+// string is passed to riff_str_intern()
+riff_str *riff_str_new_tmp(const char *start, size_t len) {
+    if (riff_unlikely(!len))
+        return st->empty;
+    riff_str *s = new_tmp(len);
+    memcpy(s->str, start, len);
+    return s;
+}
+
+// Return the interned equivalent of a string
+riff_str *riff_str_intern(riff_str *s) {
+    if (riff_likely(!riff_str_transient(s)))
+        return s;
+    return riff_str_new(s->str, riff_strlen(s));
+}
+
 riff_str *riff_strcat(char *l, char *r, size_t llen, size_t rlen) {
     size_t len = llen + rlen;
-    char new[len];
-    memcpy(new, l, llen);
-    memcpy(new + llen, r, rlen);
-    return riff_str_new(new, len);
+    if (riff_unlikely(!len))
+        return st->empty;
+    riff_str *s = new_tmp(len);
+    memcpy(s->str, l, llen);
+    memcpy(s->str + llen, r, rlen);
+    return s;
+}
+
+static riff_strbuf *new_buf(size_t cap) {
+    riff_strbuf *b = malloc(sizeof(riff_strbuf) + cap);
+    b->next = st->bufs;
+    b->mark = riff_gc_state == GC_STATE_PROPAGATE;
+    b->len  = 0;
+    b->cap  = cap;
+    st->bufs = b;
+    riff_gc_account(sizeof(riff_strbuf) + cap);
+    return b;
+}
+
+// Create a view of the first `len` bytes of a buffer
+static riff_str *new_view(riff_strbuf *b, size_t len) {
+    riff_str *s = malloc(sizeof(riff_str) + sizeof(riff_strbuf *));
+    *s = (riff_str) {
+        .hash  = 0,
+        .hints = RIFF_STR_HINT_PENDING,
+        .extra = 0,
+        .flags = RIFF_STR_TRANSIENT | RIFF_STR_VIEW,
+        .mark  = riff_gc_state == GC_STATE_PROPAGATE,
+        .len   = len,
+        .str   = b->data,
+        .next  = st->tmp
+    };
+    riff_str_buf(s) = b;
+    // A marked view must keep its buffer alive
+    b->mark |= s->mark;
+    st->tmp = s;
+    riff_gc_account(sizeof(riff_str) + sizeof(riff_strbuf *));
+    return s;
+}
+
+// Append `rlen` bytes to `l`, returning a view of the result. The bytes are
+// written in place if `l` spans its entire buffer and there's room; otherwise
+// the contents are copied into a new buffer with room to grow, making
+// repeated appends amortized O(1).
+riff_str *riff_str_append(riff_str *l, const char *r, size_t rlen) {
+    size_t llen = riff_strlen(l);
+    size_t len  = llen + rlen;
+    if (riff_unlikely(!len))
+        return st->empty;
+    riff_strbuf *b;
+    if (riff_str_view(l)
+            && (b = riff_str_buf(l))->len == llen
+            && len < b->cap) {
+        memcpy(b->data + llen, r, rlen);
+    } else {
+        b = new_buf(len < STR_BUF_MIN_CAP / 2 ? STR_BUF_MIN_CAP : len * 2);
+        memcpy(b->data, l->str, llen);
+        memcpy(b->data + llen, r, rlen);
+    }
+    b->data[len] = '\0';
+    b->len = len;
+    return new_view(b, len);
+}
+
+// Give a view whose buffer has been appended to a private, NUL-terminated
+// copy of its contents
+void riff_str_flatten(riff_str *s) {
+    size_t len = riff_strlen(s);
+    riff_strbuf *b = new_buf(len + 1);
+    memcpy(b->data, s->str, len);
+    b->data[len] = '\0';
+    b->len = len;
+    b->mark |= s->mark;
+    riff_str_buf(s) = b;
+    s->str = b->data;
 }
 
 static inline riff_int normalize_index(riff_int orig, size_t len) {
@@ -7,21 +7,98 @@
 enum riff_str_hints {
     RIFF_STR_HINT_ZERO      = 1 << 0,
     RIFF_STR_HINT_COERCIBLE = 1 << 1,
+    RIFF_STR_HINT_PENDING   = 1 << 2, // Hints not computed yet
+    RIFF_STR_HINT_NUM       = 1 << 3, // `num` filled in
+    RIFF_STR_HINT_INT       = 1 << 4, // Entire string is an integer (`num.i`)
+    RIFF_STR_HINT_NUMERIC   = 1 << 5, // Entire string is a number
 };
 
-#define riff_str_haszero(s)   ((s)->hints & RIFF_STR_HINT_ZERO)
-#define riff_str_coercible(s) ((s)->hints & RIFF_STR_HINT_COERCIBLE)
+// NOTE: Strings are parsed for numeric coercion at most once. The first
+// coercion records riff_strtod()'s result in `num.f`, along with whether it
+// consumed the entire string. If riff_strtoll() consumes the entire string
+// as well and agrees with riff_strtod(), the integer is recorded in `num.i`
+// instead.
 
-#define riff_str_eq(x,y)      ((x) == (y))
+// NOTE: Transient strings are not interned and carry no hash. They're used
+// for results which are likely to be thrown away (e.g. `read()` and `#`),
+// and are interned on demand when used as a table key. Transient strings
+// can't be compared by address.
+//
+// Strings built by repeated concatenation (`#=`) are views: transient strings
+// whose contents live in a shared, growable buffer. Appending to the view
+// spanning the whole buffer writes in place; older views remain valid
+// prefixes, but aren't NUL-terminated. riff_str_cstr() should be used
+// wherever a C string is expected.
+enum riff_str_flags {
+    RIFF_STR_TRANSIENT = 1 << 0,
+    RIFF_STR_VIEW      = 1 << 1,
+};
+
+typedef struct riff_strbuf riff_strbuf;
+
+struct riff_strbuf {
+    riff_strbuf *next;
+    uint8_t      mark;
+    size_t       len;   // Length of the longest view of the buffer
+    size_t       cap;
+    char         data[];
+};
+
+#define riff_str_haszero(s)   (riff_str_hints(s) & RIFF_STR_HINT_ZERO)
+#define riff_str_coercible(s) (riff_str_hints(s) & RIFF_STR_HINT_COERCIBLE)
+#define riff_str_transient(s) ((s)->flags & RIFF_STR_TRANSIENT)
+#define riff_str_view(s)      ((s)->flags & RIFF_STR_VIEW)
+#define riff_str_buf(s)       (*(riff_strbuf **) ((s) + 1))
+
+#define riff_str_eq(x,y) \
+    ((x) == (y) || \
+     ((((x)->flags | (y)->flags) & RIFF_STR_TRANSIENT) && \
+      ((x)->len == (y)->len) && !memcmp((x)->str, (y)->str, (x)->len)))
 #define riff_str_eq_raw(x,y) \
     (((x)->hash == (y)->hash) && ((x)->len == (y)->len) && !memcmp((x)->str, (y)->str, (x)->len))
 #define riff_str_hash(s)      ((s)->hash)
 #define riff_strlen(s)        ((s)->len)
 
+void      riff_str_init_hints(riff_str *);
+void      riff_str_init_num(riff_str *);
+
+static inline uint8_t riff_str_hints(riff_str *s) {
+    if (riff_unlikely(s->hints & RIFF_STR_HINT_PENDING)) {
+        riff_str_init_hints(s);
+    }
+    return s->hints;
+}
+
+// Return the hints of a string, parsing it for numeric coercion if it hasn't
+// been already
+static inline uint8_t riff_str_num(riff_str *s) {
+    if (riff_unlikely(!(s->hints & RIFF_STR_HINT_NUM))) {
+        riff_str_init_num(s);
+    }
+    return s->hints;
+}
+
+static inline riff_int str2int(riff_str *s) {
+    if (riff_likely(riff_str_num(s) & RIFF_STR_HINT_INT))
+        return s->num.i;
+    char *end;
+    return riff_strtoll(riff_str_cstr(s), &end, 0);
+}
+
+static inline riff_float str2flt(riff_str *s) {
+    return riff_str_num(s) & RIFF_STR_HINT_INT ? (riff_float) s->num.i
+                                               : s->num.f;
+}
+
 void      riff_stab_init(void);
+void      riff_stab_sweep_begin(void);
+size_t    riff_stab_sweep(size_t);
 riff_str *riff_str_new_extra(const char *, size_t, uint8_t);
 riff_str *riff_str_new(const char *, size_t);
+riff_str *riff_str_new_tmp(const char *, size_t);
+riff_str *riff_str_intern(riff_str *);
 riff_str *riff_strcat(char *, char *, size_t, size_t);
+riff_str *riff_str_append(riff_str *, const char *, size_t);
 riff_str *riff_substr(char *, size_t, riff_int, riff_int, riff_int);
 
 static inline size_t riff_tostr(riff_val *v, char **buf) {
@@ -29,10 +106,10 @@ static inline size_t riff_tostr(riff_val *v, char **buf) {
     case TYPE_NULL:
         *buf = riff_str_new("", 0)->str;
         return 0;
-    case TYPE_INT:   return sprintf(*buf, "%"PRId64, v->i);
-    case TYPE_FLOAT: return sprintf(*buf, FLT_PRINT_FMT, v->f);
+    case TYPE_INT:   return riff_lltostr(v->i, *buf);
+    case TYPE_FLOAT: return riff_gtostr(v->f, FLT_PRINT_PREC, *buf);
     case TYPE_STR:
-        *buf = v->s->str;
+        *buf = riff_str_cstr(v->s);
         return riff_strlen(v->s);
     case TYPE_REGEX: return sprintf(*buf, "regex: %p", v->r);
     case TYPE_FILE:  return sprintf(*buf, "file: %p", v->fh->p);
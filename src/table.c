@@ -1,8 +1,10 @@
 #include "table.h"
 
+#include "gc.h"
 #include "mem.h"
 #include "string.h"
 #include "util.h"
+#include "vm.h"
 
 #include <ctype.h>
 #include <math.h>
@@ -11,15 +13,25 @@
 
 #define T_MIN_LOAD_FACTOR  0.5
 
-#define HT_MIN_CAP         8
-#define HT_MIN_LOAD_FACTOR 0.4
-#define HT_MAX_LOAD_FACTOR 1.0
+#define t_live(v) ((v)->type != TYPE_NULL && (v)->type != T_EMPTY)
+
+#define HT_GROUP           8 // Slots probed at a time
+#define HT_MIN_CAP         HT_GROUP
+#define HT_MAX_LOAD_FACTOR 0.875
+
+#define CTRL_EMPTY   0x80
+#define CTRL_DELETED 0xfe
+#define ctrl_full(c) ((c) < 0x80)
+
+#define HT_FOREACH(h,s) \
+    for (ht_slot *(s) = (h)->slots; (s) < (h)->slots + (h)->cap; ++(s)) \
+        if (ctrl_full((h)->ctrl[(s) - (h)->slots]))
 
-static inline ht_node  *next(ht_node *);
 static uint32_t         riff_htab_logical_size(riff_htab *);
 static inline riff_val *riff_htab_delete_val(riff_htab *, riff_val *);
 
 void riff_tab_init(riff_tab *t) {
+    t->gclist = NULL;
     t->hint  = 0;
     t->lsize = 0;
     t->psize = 0;
@@ -30,6 +42,35 @@ void riff_tab_init(riff_tab *t) {
     riff_htab_init(t->h);
 }
 
+void riff_tab_free(riff_tab *t) {
+    riff_htab *h = t->h;
+    HT_FOREACH(h, s)
+        free(s->v);
+    free(h->ctrl);
+    free(h->slots);
+    free(h);
+    free(t->nullv);
+    free(t->v);
+    free(t);
+}
+
+// Mark everything referenced by a table's keys and values. Returns the
+// approximate size of the table in bytes.
+size_t riff_tab_traverse(riff_tab *t) {
+    for (uint32_t i = 0; i < t->cap; ++i)
+        riff_gc_mark_val(&t->v[i]);
+    riff_htab *h = t->h;
+    HT_FOREACH(h, s) {
+        riff_gc_mark_val(&s->k);
+        riff_gc_mark_val(s->v);
+    }
+    riff_gc_mark_val(t->nullv);
+    return sizeof(riff_tab) + sizeof(riff_htab)
+        + t->cap * sizeof(riff_val)
+        + h->cap * (sizeof(ht_slot) + 1)
+        + h->psize * sizeof(riff_val);
+}
+
 static riff_val *reduce_key(riff_val *s, riff_val *d) {
     switch (s->type) {
     case TYPE_FLOAT:
@@ -42,8 +83,15 @@ static riff_val *reduce_key(riff_val *s, riff_val *d) {
         if (riff_likely(!riff_str_coercible(s->s))) {
             return s;
         }
+        if (riff_str_num(s->s) & RIFF_STR_HINT_INT) {
+            set_int(d, s->s->num.i);
+            if (!d->i) {
+                return riff_str_haszero(s->s) ? d : s;
+            }
+            return d;
+        }
         char *end;
-        riff_int i = riff_strtoll(s->s->str, &end, 0);
+        riff_int i = riff_strtoll(riff_str_cstr(s->s), &end, 0);
         if (!*end) {
             set_int(d, i);
             if (!i) {
@@ -51,7 +99,7 @@ static riff_val *reduce_key(riff_val *s, riff_val *d) {
             }
             return d;
         }
-        riff_float f = riff_strtod(s->s->str, &end, 0);
+        riff_float f = riff_strtod(riff_str_cstr(s->s), &end, 0);
         if (!*end) {
             set_flt(d, f);
             if (f == 0.0) {
@@ -76,7 +124,7 @@ riff_int riff_tab_logical_size(riff_tab *t) {
     }
     riff_int l = 0;
     for (int i = 0; i < t->cap; ++i) {
-        if (t->v[i] && !is_null(t->v[i]))
+        if (t_live(&t->v[i]))
             ++l;
     }
     // Include special "null" index
@@ -88,17 +136,13 @@ riff_int riff_tab_logical_size(riff_tab *t) {
 
 // Don't call if k < 0
 static int t_exists(riff_tab *t, riff_int k) {
-    return k < t->cap && t->v[k] != NULL;
+    return k < t->cap && t->v[k].type != T_EMPTY;
 }
 
 static inline void riff_htab_collect_keys(riff_htab *h, riff_val *keys, int *n) {
-    for (uint32_t i = 0; i < h->cap; ++i) {
-        ht_node *node = h->nodes[i];
-        while (node) {
-            if (riff_likely(!is_null(node->v)))
-                keys[(*n)++] = (riff_val) {node->k.val->type, node->k.val->i};
-            node = next(node);
-        }
+    HT_FOREACH(h, s) {
+        if (riff_likely(!is_null(s->v)))
+            keys[(*n)++] = s->k;
     }
 }
 
@@ -111,7 +155,7 @@ riff_val *riff_tab_collect_keys(riff_tab *t) {
     riff_val *keys = malloc(len * sizeof(riff_val));
     int n = 0;
     for (uint32_t i = 0; i < t->cap && n <= len; ++i) {
-        if (t_exists(t,i) && !is_null(t->v[i])) {
+        if (t_live(&t->v[i])) {
             keys[n++] = (riff_val) {TYPE_INT, .i = i};
         }
     }
@@ -135,7 +179,12 @@ static inline int would_fit(riff_tab *t, riff_int k) {
 }
 
 riff_val *riff_tab_lookup(riff_tab *t, riff_val *k) {
-    riff_val tmp;
+    riff_val tmp, stmp;
+    // Table keys are always interned
+    if (is_str(k) && riff_unlikely(riff_str_transient(k->s))) {
+        set_str(&stmp, riff_str_intern(k->s));
+        k = &stmp;
+    }
     k = reduce_key(k, &tmp);
     switch (k->type) {
     case TYPE_NULL:
@@ -144,7 +193,7 @@ riff_val *riff_tab_lookup(riff_tab *t, riff_val *k) {
         if (k->i >= 0) {
             riff_int ki = k->i;
             if (t_exists(t, ki))
-                return t->v[ki];
+                return &t->v[ki];
             if (would_fit(t, ki))
                 return riff_tab_insert_int(t, ki, NULL);
         }
@@ -159,127 +208,147 @@ static uint32_t new_size(uint32_t n, uint32_t cap, riff_int k) {
     return (uint32_t) (sz / T_MIN_LOAD_FACTOR) + 1;
 }
 
+// Grow the array part, moving over any values in range from the hash part
+static void t_resize(riff_tab *t, uint32_t new_cap) {
+    uint32_t old_cap = t->cap;
+    riff_val *old = t->v;
+    riff_val *new = malloc(new_cap * sizeof(riff_val));
+    if (old_cap) {
+        memcpy(new, old, old_cap * sizeof(riff_val));
+        riff_vm_rebase(old, old_cap, new);
+        free(old);
+    }
+    riff_gc_account((new_cap - old_cap) * sizeof(riff_val));
+    for (uint32_t i = old_cap; i < new_cap; ++i) {
+        riff_val *v = t->h->psize
+            ? riff_htab_delete_val(t->h, &(riff_val){TYPE_INT, .i = i})
+            : NULL;
+        if (v) {
+            new[i] = *v;
+            riff_vm_rebase(v, 1, &new[i]);
+            free(v);
+            t->psize++;
+        } else {
+            new[i].type = T_EMPTY;
+        }
+    }
+    t->v = new;
+    t->cap = new_cap;
+}
+
 // Don't call with k < 0
 riff_val *riff_tab_insert_int(riff_tab *t, riff_int k, riff_val *v) {
-    if (k >= t->cap) {
-        uint32_t old_cap = t->cap;
-        uint32_t new_cap = new_size(t->psize, old_cap, k);
-        t->v = realloc(t->v, new_cap * sizeof(riff_val *));
-        for (uint32_t i = old_cap; i < new_cap; ++i) {
-            if (t_exists(t,i)) {
-                continue;
-            }
-            t->v[i] = riff_htab_delete_val(t->h, &(riff_val){TYPE_INT, .i = i});
-            if (t->v[i]) {
-                t->psize++;
-            }
-        }
-        t->cap = new_cap;
+    if (k >= t->cap)
+        t_resize(t, new_size(t->psize, t->cap, k));
+    if (riff_likely(v != NULL)) {
+        riff_gc_barrier(t);
     }
-    if (riff_likely(!t_exists(t,k))) {
-        t->v[k] = v == NULL ? v_newnull() : v_copy(v);
+    riff_val *e = &t->v[k];
+    if (riff_likely(e->type == T_EMPTY)) {
+        *e = v == NULL ? (riff_val) {TYPE_NULL} : *v;
         t->psize++;
     } else if (riff_likely(v != NULL)) {
-        *t->v[k] = *v;
+        *e = *v;
     }
     t->hint = 1;
-    return t->v[k];
+    return e;
 }
 
 // Hash tables
 
 void riff_htab_init(riff_htab *h) {
-    h->nodes = NULL;
+    h->ctrl  = NULL;
+    h->slots = NULL;
     h->lsize = 0;
     h->psize = 0;
+    h->dsize = 0;
     h->mask  = 0;
     h->cap   = 0;
     h->hint  = 0;
 }
 
-static inline ht_node *next(ht_node *n) {
-    return n->next;
+// Mark the keys and values of a hash table with string keys
+void riff_htab_traverse_str(riff_htab *h) {
+    HT_FOREACH(h, s) {
+        riff_gc_mark_str(s->k.s);
+        riff_gc_mark_val(s->v);
+    }
 }
 
 static uint32_t riff_htab_logical_size(riff_htab *h) {
     if (!h->hint)
         return h->lsize;
     uint32_t l = 0;
-    for (uint32_t i = 0; i < h->cap; ++i) {
-        ht_node *n = h->nodes[i];
-        while (n) {
-            if (!is_null(n->v)) {
-                ++l;
-            }
-            n = next(n);
+    HT_FOREACH(h, s) {
+        if (!is_null(s->v)) {
+            ++l;
         }
     }
     h->hint = 0;
     return (h->lsize = l);
 }
 
-static inline double ht_potential_lf(riff_htab *h) {
-    double n1 = (double) h->psize + 1.0;
-    double n2 = (double) h->cap;
-    return n1 / n2;
+// Integer and float keys are scrambled so that both the low bits (slot
+// position) and the high bits (control byte tag) vary between keys
+static inline uint32_t hash_val(riff_val *k) {
+    if (is_str(k))
+        return riff_str_hash(k->s);
+    return (uint32_t) (((uint64_t) k->i * 0x9e3779b97f4a7c15) >> 32);
 }
 
-static inline uint32_t hashrot(uint32_t lo, uint32_t hi) {
-    lo ^= hi; hi  = rol(hi, 14);
-    lo -= hi; hi  = rol(hi, 5);
-    hi ^= lo; hi -= rol(lo, 13);
-    return hi;
+#define hash_tag(h) ((uint8_t) ((h) >> 25))
+
+// Control bytes are probed HT_GROUP at a time using bitwise operations on a
+// 64-bit word (SWAR). Each match function below returns a word with the high
+// bit set in each byte satisfying the condition.
+typedef uint64_t ht_group;
+
+#define GROUP_LSBS 0x0101010101010101
+#define GROUP_MSBS 0x8080808080808080
+
+static inline ht_group load_group(const uint8_t *ctrl) {
+    ht_group g;
+    memcpy(&g, ctrl, sizeof g);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    g = __builtin_bswap64(g);
+#endif
+    return g;
 }
 
-static inline uint32_t anchor(riff_val *k, uint32_t mask) {
-    switch (k->type) {
-    case TYPE_INT: return ((uint32_t) k->i) & mask;
-    case TYPE_STR: return riff_str_hash(k->s) & mask;
-    default:
-        return hashrot(
-            (uint32_t) (k->i & UINT32_MAX),
-            (uint32_t) ((k->i >> 32) & UINT32_MAX)
-        ) & mask;
-    }
+// May report false positives following a true match; keys are always
+// compared anyway
+static inline ht_group match_tag(ht_group g, uint8_t tag) {
+    ht_group x = g ^ (GROUP_LSBS * tag);
+    return (x - GROUP_LSBS) & ~x & GROUP_MSBS;
 }
 
-static inline void insert_node(ht_node **nodes, ht_node *new, uint32_t i) {
-    ht_node *n = nodes[i];
-    if (riff_unlikely(!n)) {
-        nodes[i] = new;
-        return;
-    }
-    while (n->next) {
-        n = next(n);
-    }
-    n->next = new;
-}
-
-#define HT_RESIZE(mask_type) \
-    ht_node **new_nodes = calloc(new_cap, sizeof(ht_node *)); \
-    for (uint32_t i = 0; i < h->cap; ++i) { \
-        ht_node *n = h->nodes[i]; \
-        while (n) { \
-            insert_node(new_nodes, n, (mask_type)); \
-            ht_node *p = n; \
-            n = next(n); \
-            p->next = NULL; \
-        } \
-    } \
-    free(h->nodes); \
-    h->nodes = new_nodes; \
-    h->mask = new_cap - 1; \
-    h->cap = new_cap;
+static inline ht_group match_empty(ht_group g) {
+    return g & (~g << 6) & GROUP_MSBS;
+}
 
-static inline void ht_resize_val(riff_htab *h, size_t new_cap) {
-    HT_RESIZE(anchor(n->k.val, new_cap-1))
+static inline ht_group match_empty_or_deleted(ht_group g) {
+    return g & (~g << 7) & GROUP_MSBS;
 }
 
-static inline void ht_resize_str(riff_htab *h, size_t new_cap) {
-    HT_RESIZE(n->k.str->hash & (new_cap-1))
+static inline uint32_t first_match(ht_group m) {
+#ifdef __GNUC__
+    return (uint32_t) __builtin_ctzll(m) >> 3;
+#else
+    uint32_t i = 0;
+    while (!(m & 0x80)) {
+        m >>= 8;
+        ++i;
+    }
+    return i;
+#endif
 }
 
-#define node_eq_str(s1, s2) (riff_str_eq(s1, s2))
+// Probe groups of slots in triangular steps, which visits every group since
+// the number of groups is a power of 2
+#define HT_PROBE(h, hash, pos) \
+    for (uint32_t pos = (hash) & (h)->mask & ~(HT_GROUP - 1), step_ = 0; \
+         ; \
+         step_ += HT_GROUP, pos = (pos + step_) & (h)->mask)
 
 static inline int node_eq_val(riff_val *v1, riff_val *v2) {
     if (riff_unlikely(v1->type != v2->type)) {
@@ -287,74 +356,113 @@ static inline int node_eq_val(riff_val *v1, riff_val *v2) {
     }
     switch (v1->type) {
     case TYPE_FLOAT: return v1->f == v2->f;
-    case TYPE_STR: return node_eq_str(v1->s, v2->s);
+    case TYPE_STR: return riff_str_eq(v1->s, v2->s);
     default: return v1->i == v2->i;
     }
 }
 
-#define HT_LOOKUP(type, mask) \
-    if (riff_unlikely(h->nodes == NULL)) \
-        return riff_htab_insert_##type(h, k, NULL); \
-    ht_node *n = h->nodes[(mask)]; \
-    while (n) { \
-        if (riff_unlikely(node_eq_##type(n->k.type, k))) \
-            return n->v; \
-        n = next(n); \
+#define node_eq_str(v, k) (riff_str_eq((v)->s, k))
+
+// Evaluates to the slot holding key `k`, or NULL
+#define HT_FIND(type, hash) \
+    if (riff_likely(h->cap)) { \
+        uint32_t hv = (hash); \
+        uint8_t tag = hash_tag(hv); \
+        HT_PROBE(h, hv, pos) { \
+            ht_group g = load_group(h->ctrl + pos); \
+            for (ht_group m = match_tag(g, tag); m; m &= m - 1) { \
+                ht_slot *s = &h->slots[pos + first_match(m)]; \
+                if (riff_likely(node_eq_##type(&s->k, k))) \
+                    return s; \
+            } \
+            if (riff_likely(match_empty(g))) \
+                return NULL; \
+        } \
     } \
-    return riff_htab_insert_##type(h, k, NULL);
+    return NULL;
+
+static inline ht_slot *find_val(riff_htab *h, riff_val *k) {
+    HT_FIND(val, hash_val(k))
+}
+
+static inline ht_slot *find_str(riff_htab *h, riff_str *k) {
+    HT_FIND(str, riff_str_hash(k))
+}
+
+// Claim the first free slot in the probe sequence for hash `hv`
+static ht_slot *claim_slot(riff_htab *h, uint32_t hv) {
+    HT_PROBE(h, hv, pos) {
+        ht_group m = match_empty_or_deleted(load_group(h->ctrl + pos));
+        if (riff_likely(m)) {
+            uint32_t i = pos + first_match(m);
+            if (h->ctrl[i] == CTRL_DELETED)
+                h->dsize--;
+            h->ctrl[i] = hash_tag(hv);
+            return &h->slots[i];
+        }
+    }
+}
+
+// Rehash into a table sized for the number of live entries, dropping any
+// deleted slots. The table may grow or shrink.
+static void ht_resize(riff_htab *h) {
+    uint32_t new_cap = HT_MIN_CAP;
+    while (h->psize * 2 > new_cap * HT_MAX_LOAD_FACTOR)
+        new_cap <<= 1;
+    uint8_t *old_ctrl  = h->ctrl;
+    ht_slot *old_slots = h->slots;
+    uint32_t old_cap   = h->cap;
+    h->ctrl  = malloc(new_cap);
+    h->slots = malloc(new_cap * sizeof(ht_slot));
+    h->mask  = new_cap - 1;
+    h->cap   = new_cap;
+    h->dsize = 0;
+    memset(h->ctrl, CTRL_EMPTY, new_cap);
+    riff_gc_account(new_cap * (sizeof(ht_slot) + 1));
+    for (uint32_t i = 0; i < old_cap; ++i) {
+        if (ctrl_full(old_ctrl[i]))
+            *claim_slot(h, hash_val(&old_slots[i].k)) = old_slots[i];
+    }
+    free(old_ctrl);
+    free(old_slots);
+}
+
+// Add a key known not to be in the table
+static inline riff_val *ht_add(riff_htab *h, riff_val *k, uint32_t hv, riff_val *v) {
+    if (riff_unlikely(h->psize + h->dsize + 1 > h->cap * HT_MAX_LOAD_FACTOR))
+        ht_resize(h);
+    ht_slot *s = claim_slot(h, hv);
+    s->k = *k;
+    s->v = v == NULL ? v_newnull() : v_copy(v);
+    h->psize++;
+    riff_gc_account(sizeof(riff_val));
+    return s->v;
+}
 
 riff_val *riff_htab_lookup_val(riff_htab *h, riff_val *k) {
     h->hint = 1;
-    HT_LOOKUP(val, anchor(k, h->mask))
+    ht_slot *s = find_val(h, k);
+    return riff_likely(s != NULL) ? s->v : ht_add(h, k, hash_val(k), NULL);
 }
 
 riff_val *riff_htab_lookup_str(riff_htab *h, riff_str *k) {
-    HT_LOOKUP(str, riff_str_hash(k) & (h->mask))
-}
-
-static inline ht_node *new_node_val(riff_val *k, riff_val *v) {
-    ht_node *new = malloc(sizeof(ht_node));
-    *new = (ht_node) {
-        .k.val = v_copy(k),
-        v == NULL ? v_newnull() : v_copy(v),
-        NULL
-    };
-    return new;
-}
-
-static inline ht_node *new_node_str(riff_str *k, riff_val *v) {
-    ht_node *new = malloc(sizeof(ht_node));
-    *new = (ht_node) {
-        .k.str = k,
-        v == NULL ? v_newnull() : v_copy(v),
-        NULL
-    };
-    return new;
-}
-
-#define HT_INSERT(type, mask_type) \
-    if (riff_unlikely(h->nodes == NULL)) { \
-        h->nodes = calloc(HT_MIN_CAP, sizeof(ht_node *)); \
-        h->mask = HT_MIN_CAP - 1; \
-        h->cap = HT_MIN_CAP; \
-    } else { \
-        double lf = ht_potential_lf(h); \
-        if (lf > HT_MAX_LOAD_FACTOR) \
-            ht_resize_##type(h, h->cap << 1); \
-        else if (riff_unlikely(h->cap > HT_MIN_CAP && lf < HT_MIN_LOAD_FACTOR)) \
-            ht_resize_##type(h, h->cap >> 1); \
-    } \
-    ht_node *new = new_node_##type(k,v); \
-    insert_node(h->nodes, new, (mask_type)); \
-    h->psize++; \
-    return new->v;
+    ht_slot *s = find_str(h, k);
+    return riff_likely(s != NULL) ? s->v
+        : ht_add(h, &(riff_val) {TYPE_STR, .s = k}, riff_str_hash(k), NULL);
+}
 
+// NOTE: Inserting a key which is already present leaves the existing value
+// untouched, e.g. a user-defined function doesn't replace a library function
+// of the same name
 riff_val *riff_htab_insert_val(riff_htab *h, riff_val *k, riff_val *v) {
-    HT_INSERT(val, anchor(k, h->mask))
+    ht_slot *s = find_val(h, k);
+    return riff_unlikely(s != NULL) ? s->v : ht_add(h, k, hash_val(k), v);
 }
 
 riff_val *riff_htab_insert_str(riff_htab *h, riff_str *k, riff_val *v) {
-    HT_INSERT(str, riff_str_hash(k) & (h->mask))
+    ht_slot *s = find_str(h, k);
+    return riff_unlikely(s != NULL) ? s->v
+        : ht_add(h, &(riff_val) {TYPE_STR, .s = k}, riff_str_hash(k), v);
 }
 
 riff_val *riff_htab_insert_cstr(riff_htab *h, const char *k, riff_val *v) {
@@ -362,21 +470,11 @@ riff_val *riff_htab_insert_cstr(riff_htab *h, const char *k, riff_val *v) {
 }
 
 static inline riff_val *riff_htab_delete_val(riff_htab *h, riff_val *k) {
-    if (riff_unlikely(h->nodes == NULL))
+    ht_slot *s = find_val(h, k);
+    if (s == NULL)
         return NULL;
-    ht_node **a = &h->nodes[anchor(k, h->mask)];
-    ht_node *n = *a;
-    while (n) {
-        if (node_eq_val(n->k.val, k)) {
-            *a = n->next;
-            riff_val *v = n->v;
-            free(n->k.val);
-            free(n);
-            h->psize--;
-            return v;
-        }
-        a = &n->next;
-        n = next(n);
-    }
-    return NULL;
+    h->ctrl[s - h->slots] = CTRL_DELETED;
+    h->psize--;
+    h->dsize++;
+    return s->v;
 }
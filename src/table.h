@@ -3,14 +3,16 @@
 
 #include "value.h"
 
-// NOTE: The "array" part of the table is an array of riff_val pointers, instead
-// of a flattened array of riff_val objects. This facilitates the mobility of
-// values between the hash table and the "array" part. E.g. The address of a
-// riff_val object can be pushed on the VM stack while in the hash table, but
-// get evicted and thrown into the array part before the VM actually
-// dereferences it.
+// NOTE: The "array" part of the table stores riff_val objects inline. The VM
+// may hold the address of an element (e.g. the target of an assignment) while
+// evaluating code which causes the array part to be reallocated, or causes a
+// value to be moved from the hash table into the array part. Whenever that
+// happens, addresses held on the VM stack are updated to the element's new
+// location (see riff_vm_rebase()).
 struct riff_tab {
-    riff_val   **v;
+    riff_gc_obj  gc;
+    riff_tab    *gclist;
+    riff_val    *v;
     riff_htab   *h;
     riff_val    *nullv;
     uint32_t    lsize;
@@ -19,27 +21,35 @@ struct riff_tab {
     int         hint: 1;
 };
 
-typedef struct ht_node ht_node;
+// Type tag of array slots which have never been looked up or assigned to
+#define T_EMPTY 0xfd
+
+// NOTE: The hash table uses open addressing. Keys are stored inline in a flat
+// array of slots, alongside a parallel array of control bytes: each byte is
+// either EMPTY, DELETED, or the top 7 bits of the hash of the key in the
+// corresponding slot. Lookups scan the control bytes of a group of slots at
+// a time, only comparing keys whose tags match. Values are still allocated
+// individually, for the same reason as the array part: their addresses must
+// stay put when the table is resized.
+typedef struct {
+    riff_val  k;
+    riff_val *v;
+} ht_slot;
 
 struct riff_htab {
-    ht_node  **nodes;
+    uint8_t   *ctrl;
+    ht_slot   *slots;
     uint32_t   lsize;
     uint32_t   psize;
+    uint32_t   dsize;
     uint32_t   mask;
     uint32_t   cap;
     int        hint: 1;
 };
 
-struct ht_node {
-    union {
-        riff_str *str;
-        riff_val *val;
-    } k;
-    riff_val *v;
-    ht_node  *next;
-};
-
 void      riff_tab_init(riff_tab *);
+void      riff_tab_free(riff_tab *);
+size_t    riff_tab_traverse(riff_tab *);
 riff_int  riff_tab_logical_size(riff_tab *);
 riff_val *riff_tab_collect_keys(riff_tab *);
 riff_val *riff_tab_lookup(riff_tab *, riff_val *);
@@ -47,6 +57,7 @@ riff_val *riff_tab_insert_int(riff_tab *, riff_int, riff_val *);
 riff_val *riff_tab_insert(riff_tab *, riff_val *, riff_val *, int);
 
 void      riff_htab_init(riff_htab *);
+void      riff_htab_traverse_str(riff_htab *);
 riff_val *riff_htab_lookup_val(riff_htab *, riff_val *);
 riff_val *riff_htab_lookup_str(riff_htab *, riff_str *);
 riff_val *riff_htab_insert_val(riff_htab *, riff_val *, riff_val *);
@@ -3,6 +3,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 
 // Returns the numeric value of the character `c` for a given radix.
 // Returns -1 if the character is outside the range of the base.
@@ -21,7 +22,141 @@ static int baseval(int c, int base) {
 
 #define MAXNUMSTR 128
 
+// Fast paths for plain decimal numbers
+//
+// Most numeric strings seen at runtime (fields, CSV columns, etc.) are short
+// decimal numbers without underscores or base prefixes. These are parsed in a
+// single pass without copying: digits are accumulated into a 64-bit integer,
+// and the result is exact whenever the significand fits in a double and the
+// decimal exponent is small enough for one correctly rounded multiplication
+// or division by an exact power of ten (Clinger's fast path). Anything else
+// (underscores, prefixes, long significands, large exponents) falls back to
+// the general routines below, which copy the digits and defer to the C
+// library.
+
+static inline int is_space(int c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static inline int is_digit(int c) {
+    return (unsigned) (c - '0') < 10;
+}
+
+// Longest number handled by the fast paths; keeps clear of MAXNUMSTR
+#define FAST_NUMSTR_MAX 64
+
+static const double exact_pow10[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Returns 1 and sets `*res` and `*end` on success; 0 if the general routine
+// is needed.
+static int fast_strtod(const char *str, double *res, char **end) {
+    const char *s = str;
+    while (is_space(*s))
+        ++s;
+    int neg = 0;
+    if (*s == '+' || *s == '-')
+        neg = *s++ == '-';
+    if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+        return 0;
+    const char *start = s;
+    uint64_t w = 0;
+    int nd = 0;    // Significant digits
+    int e10 = 0;
+    while (*s == '0')
+        ++s;
+    for (; is_digit(*s); ++s, ++nd)
+        w = w * 10 + (*s - '0');
+    if (*s == '.') {
+        ++s;
+        if (!nd) {
+            for (; *s == '0'; ++s)
+                --e10;
+        }
+        for (; is_digit(*s); ++s, ++nd, --e10)
+            w = w * 10 + (*s - '0');
+    }
+
+    // strtod() doesn't apply the sign when there are no digits (e.g. "-")
+    if (s == start || (s == start + 1 && *start == '.'))
+        neg = 0;
+    if (*s == 'e' || *s == 'E') {
+        const char *t = s + 1;
+        int eneg = 0;
+        if (*t == '+' || *t == '-')
+            eneg = *t++ == '-';
+        if (is_digit(*t)) {
+            int x = 0;
+            for (; is_digit(*t); ++t) {
+                if (x > 9999)
+                    return 0;
+                x = x * 10 + (*t - '0');
+            }
+            e10 += eneg ? -x : x;
+            s = t;
+        }
+    }
+    if (*s == '_' || nd > 19 || s - start > FAST_NUMSTR_MAX)
+        return 0;
+    double d;
+    if (!w) {
+        d = 0.0;
+    } else if (w <= (1ull << 53) && e10 >= -22 && e10 <= 22) {
+        d = (double) w;
+        d = e10 < 0 ? d / exact_pow10[-e10] : d * exact_pow10[e10];
+    } else {
+        return 0;
+    }
+    *res = neg ? -d : d;
+    *end = (char *) s;
+    return 1;
+}
+
+// As above; gives up on anything that might overflow
+static int fast_strtoll(const char *str, int64_t *res, char **end) {
+    const char *s = str;
+    while (is_space(*s))
+        ++s;
+    int neg = 0;
+    if (*s == '+' || *s == '-')
+        neg = *s++ == '-';
+    if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X' || s[1] == 'b' || s[1] == 'B'))
+        return 0;
+    const char *start = s;
+    uint64_t u = 0;
+    for (; is_digit(*s); ++s)
+        u = u * 10 + (*s - '0');
+    if (*s == '_' || s - start > 18)
+        return 0;
+    *res = neg ? -(int64_t) u : (int64_t) u;
+    *end = (char *) s;
+    return 1;
+}
+
+static double strtod_slow(const char *str, char **end, int base);
+static int64_t strtoll_slow(const char *str, char **end, int base);
+
 double riff_strtod(const char *str, char **end, int base) {
+    double d;
+    if (base != 16 && fast_strtod(str, &d, end))
+        return d;
+    return strtod_slow(str, end, base);
+}
+
+// Riff's integer literal format
+// - Allows arbitrary underscores in numeric strings
+// - Prevents numbers prefixed with `0` from being interpreted as
+//   octal by default (base 0).
+int64_t riff_strtoll(const char *str, char **end, int base) {
+    int64_t i;
+    if ((base == 0 || base == 10) && fast_strtoll(str, &i, end))
+        return i;
+    return strtoll_slow(str, end, base);
+}
+
+static double strtod_slow(const char *str, char **end, int base) {
 
     // Eat leading whitespace
     while (isspace(*str))
@@ -117,12 +252,8 @@ parse_end:
     return strtod(buf, &dummy);
 }
 
-// Riff's integer literal format
 // Wrapper for strtoll()/strtoull()
-// - Allows arbitrary underscores in numeric strings
-// - Prevents numbers prefixed with `0` from being interpreted as
-//   octal by default (base 0).
-int64_t riff_strtoll(const char *str, char **end, int base) {
+static int64_t strtoll_slow(const char *str, char **end, int base) {
 
     // Reset base if outside valid range
     if (base < 2 || base > 36)
@@ -172,6 +303,228 @@ int64_t riff_strtoll(const char *str, char **end, int base) {
                       : (int64_t) strtoull(buf, &dummy, base);
 }
 
+// Number to string conversion
+//
+// Integers are written two digits at a time from a table of digit pairs.
+// Floats are formatted as with printf("%.*g"): the exact binary value is
+// scaled by a power of ten and rounded to the requested number of significant
+// digits using 128-bit integer arithmetic, which covers all but very large
+// and very small magnitudes. Those (along with inf/nan, precisions above 17,
+// and compilers without 128-bit integers) fall back to snprintf().
+
+static const char digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static int count_digits(uint64_t u) {
+    int n = 1;
+    for (;;) {
+        if (u < 10)    return n;
+        if (u < 100)   return n + 1;
+        if (u < 1000)  return n + 2;
+        if (u < 10000) return n + 3;
+        u /= 10000;
+        n += 4;
+    }
+}
+
+// Writes the decimal digits of `u` to `buf` (not NUL-terminated). Returns the
+// number of digits.
+static int utostr(uint64_t u, char *buf) {
+    int n = count_digits(u);
+    char *p = buf + n;
+    while (u >= 100) {
+        const char *d = digit_pairs + (u % 100) * 2;
+        u /= 100;
+        *--p = d[1];
+        *--p = d[0];
+    }
+    if (u >= 10) {
+        const char *d = digit_pairs + u * 2;
+        *--p = d[1];
+        *--p = d[0];
+    } else {
+        *--p = (char) ('0' + u);
+    }
+    return n;
+}
+
+size_t riff_lltostr(int64_t i, char *buf) {
+    char *p = buf;
+    uint64_t u = (uint64_t) i;
+    if (i < 0) {
+        *p++ = '-';
+        u = -u;
+    }
+    p += utostr(u, p);
+    *p = '\0';
+    return p - buf;
+}
+
+#ifdef __SIZEOF_INT128__
+
+typedef unsigned __int128 u128;
+
+static int bitlen128(u128 x) {
+    uint64_t hi = (uint64_t) (x >> 64);
+    return hi ? 128 - __builtin_clzll(hi)
+              : (uint64_t) x ? 64 - __builtin_clzll((uint64_t) x) : 0;
+}
+
+static u128 pow10_128(int k) {
+    u128 p = 1;
+    while (k--)
+        p *= 10;
+    return p;
+}
+
+// Sets `*q` to ⌊m × 2^e × 10^k⌋ and `*rnd` to the comparison of the remainder
+// with one half (-1, 0 or 1). Returns 0 if the operands don't fit.
+static int scale(uint64_t m, int e, int k, uint64_t *q, int *rnd) {
+    if (k > 38 || k < -38)
+        return 0;
+    u128 p = pow10_128(k < 0 ? -k : k);
+    int mb = 64 - __builtin_clzll(m);
+    int pb = bitlen128(p);
+    u128 num = m, den = 1;
+    if (k >= 0) {
+        if (mb + pb + (e > 0 ? e : 0) > 127 || (e < 0 && -e > 126))
+            return 0;
+        num *= p;
+    } else {
+        if (mb + (e > 0 ? e : 0) > 127 || pb + (e < 0 ? -e : 0) > 126)
+            return 0;
+        den = p;
+    }
+    if (e > 0)
+        num <<= e;
+    u128 r;
+    if (den == 1) {
+        int s = e < 0 ? -e : 0;
+        u128 qq = num >> s;
+        if (qq >> 64)
+            return 0;
+        *q = (uint64_t) qq;
+        if (!s) {
+            *rnd = -1;
+            return 1;
+        }
+        r = num & (((u128) 1 << s) - 1);
+        den = (u128) 1 << s;
+    } else {
+        if (e < 0)
+            den <<= -e;
+        u128 qq = num / den;
+        if (qq >> 64)
+            return 0;
+        *q = (uint64_t) qq;
+        r = num - qq * den;
+    }
+    r <<= 1;
+    *rnd = r < den ? -1 : r > den;
+    return 1;
+}
+
+#endif
+
+size_t riff_gtostr(double d, int prec, char *buf) {
+#ifdef __SIZEOF_INT128__
+    static const uint64_t pow10[] = {
+        1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull,
+        10000000ull, 100000000ull, 1000000000ull, 10000000000ull,
+        100000000000ull, 1000000000000ull, 10000000000000ull,
+        100000000000000ull, 1000000000000000ull, 10000000000000000ull,
+        100000000000000000ull
+    };
+    if (!prec)
+        prec = 1;
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof bits);
+    int be = (int) (bits >> 52) & 0x7ff;
+    if (prec > 17 || be == 0x7ff)
+        goto fallback;
+    char *p = buf;
+    if (bits >> 63)
+        *p++ = '-';
+    uint64_t m = bits & 0xfffffffffffffull;
+    if (!be && !m) {
+        *p++ = '0';
+        *p = '\0';
+        return p - buf;
+    }
+    if (be)
+        m |= 1ull << 52;
+    else
+        be = 1;
+    int e = be - 1075;
+
+    // Decimal exponent estimate; off by at most one
+    int b2 = 63 - __builtin_clzll(m) + e;
+    int x = (b2 * 78913) >> 18;
+    uint64_t q;
+    int rnd;
+    for (int tries = 0; ; ++tries) {
+        if (tries > 2 || !scale(m, e, prec - 1 - x, &q, &rnd))
+            goto fallback;
+        if (q >= pow10[prec])
+            ++x;
+        else if (q < pow10[prec-1])
+            --x;
+        else
+            break;
+    }
+
+    // Round half to even, as printf() does
+    if (rnd > 0 || (!rnd && (q & 1))) {
+        if (++q == pow10[prec]) {
+            q = pow10[prec-1];
+            ++x;
+        }
+    }
+
+    char digits[20];
+    int nd = utostr(q, digits);
+    while (nd > 1 && digits[nd-1] == '0')
+        --nd;
+    if (x < -4 || x >= prec) {
+        *p++ = digits[0];
+        if (nd > 1) {
+            *p++ = '.';
+            memcpy(p, digits + 1, nd - 1);
+            p += nd - 1;
+        }
+        *p++ = 'e';
+        *p++ = x < 0 ? '-' : '+';
+        int ax = x < 0 ? -x : x;
+        if (ax < 10)
+            *p++ = '0';
+        p += utostr((uint64_t) ax, p);
+    } else if (x < 0) {
+        *p++ = '0';
+        *p++ = '.';
+        memset(p, '0', -x - 1);
+        p += -x - 1;
+        memcpy(p, digits, nd);
+        p += nd;
+    } else if (nd <= x + 1) {
+        memcpy(p, digits, nd);
+        memset(p + nd, '0', x + 1 - nd);
+        p += x + 1;
+    } else {
+        memcpy(p, digits, x + 1);
+        p += x + 1;
+        *p++ = '.';
+        memcpy(p, digits + x + 1, nd - x - 1);
+        p += nd - x - 1;
+    }
+    *p = '\0';
+    return p - buf;
+fallback:
+#endif
+    return sprintf(buf, "%.*g", prec, d);
+}
+
 // Decodes a UTF-8 sequence, returning the unicode code point as a
 // Riff integer.
 // Source: Lua's utf8_decode()
@@ -18,8 +18,8 @@
 
 #define rol(x,n)       (((x)<<(n)) | ((x)>>(-(int)(n)&(8*sizeof(x)-1))))
 
-#define riff_lltostr(i,b)  snprintf(b, sizeof b, "%"PRId64, i)
-#define riff_dtostr(d,b)   snprintf(b, sizeof b, "%g", d)
+// Equivalent to "%g"
+#define riff_dtostr(d,b)  riff_gtostr(d, 6, b)
 #define riff_strchr(s,c)  (!!memchr(s, c, strlen(s)))
 
 // Generic dynamic array utilities
@@ -80,6 +80,8 @@
 
 double  riff_strtod(const char *, char **, int);
 int64_t riff_strtoll(const char *, char **, int);
+size_t  riff_lltostr(int64_t, char *);
+size_t  riff_gtostr(double, int, char *);
 int64_t riff_utf8tounicode(const char *, char **);
 int     riff_unicodetoutf8(char *, uint32_t);
 
@@ -1,4 +1,5 @@
 #include "conf.h"
+#include "gc.h"
 #include "table.h"
 #include "value.h"
 
@@ -8,16 +9,17 @@ riff_val *v_newnull(void) {
     return v;
 }
 
-riff_val *v_newtab(uint32_t cap) {
-    riff_val *v = malloc(sizeof(riff_val));
-    riff_tab *t = malloc(sizeof(riff_tab));
+void v_newtab(riff_val *v, uint32_t cap) {
+    riff_tab *t = riff_gc_new(sizeof(riff_tab), GC_OBJ_TAB);
     riff_tab_init(t);
     if (cap > 0) {
         t->cap = cap;
-        t->v = calloc(cap, sizeof(riff_val *));
+        t->v = malloc(cap * sizeof(riff_val));
+        for (uint32_t i = 0; i < cap; ++i)
+            t->v[i].type = T_EMPTY;
+        riff_gc_account(cap * sizeof(riff_val));
     }
     *v = (riff_val) {TYPE_TAB, .t = t};
-    return v;
 }
 
 riff_val *v_copy(riff_val *v) {
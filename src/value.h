@@ -45,16 +45,46 @@ typedef double          riff_float;
 typedef uint32_t        strhash;
 typedef struct riff_str riff_str;
 
+typedef struct riff_gc_obj riff_gc_obj;
+
+// Common header for heap objects owned by the garbage collector. Must be the
+// first member of any collectable struct.
+struct riff_gc_obj {
+    riff_gc_obj *next;
+    uint8_t      type;
+    uint8_t      mark;
+};
+
 struct riff_str {
     strhash   hash;
     uint8_t   hints;
     uint8_t   extra;
+    uint8_t   flags;
+    uint8_t   mark;
     size_t    len;
     char     *str;
     riff_str *next;
+    union {
+        riff_int   i;
+        riff_float f;
+    } num;    // Cached numeric value (see riff_str_num())
+};
+
+typedef struct riff_regex riff_regex;
+
+// Literal substring analysis of a pattern (see re_compile())
+enum riff_regex_lit {
+    RE_LIT_PURE     = 1 << 0, // Pattern matches exactly the literal
+    RE_LIT_ANCHORED = 1 << 1, // Pure literal only matching at the start
 };
 
-typedef pcre2_code riff_regex;
+struct riff_regex {
+    pcre2_code *code;
+    uint32_t    ncap;     // Number of capture groups
+    uint8_t     lit_type;
+    size_t      lit_len;
+    char       *lit;      // Substring present in every match (NULL if none)
+};
 
 // Standard PCRE2 compile options
 #define RE_ANCHORED        PCRE2_ANCHORED
@@ -79,14 +109,31 @@ typedef pcre2_code riff_regex;
 #define RE_CFLAGS          RE_DUPNAMES
 #define RE_CFLAGS_EXTRA    RE_IGNORE_BAD_ESC
 
-#define FH_STD 1
+// PCRE2's JIT compiler can't generate code when targeting WebAssembly
+#ifndef __EMSCRIPTEN__
+#define RE_JIT
+#define RE_NO_JIT PCRE2_NO_JIT
+#else
+#define RE_NO_JIT 0
+#endif
+
+#define FH_STD    1
+#define FH_CLOSED 2
+#define FH_RBUF   4 // Read with read(2) through `rbuf` rather than stdio
+#define FH_MMAP   8 // `rbuf` is a read-only mapping of the whole file
 
 typedef struct {
-    FILE     *p;
-    uint32_t  flags;
+    riff_gc_obj  gc;
+    FILE        *p;
+    uint32_t     flags;
+    char        *rbuf;
+    size_t       rpos;  // Start of unconsumed data in `rbuf`
+    size_t       rlen;  // End of buffered data in `rbuf`
+    size_t       rcap;
 } riff_file;
 
 typedef struct {
+    riff_gc_obj gc;
     riff_int from;
     riff_int to;
     riff_int itvl;
@@ -129,23 +176,31 @@ typedef struct {
                    is_int(x)   ? (riff_float) (x)->i : \
                    is_str(x)   ? str2flt((x)->s) : 0)
 
-static inline riff_int str2int(riff_str *s) {
-    char *end;
-    return riff_strtoll(s->str, &end, 0);
-}
+void riff_str_flatten(riff_str *);
 
-static inline riff_float str2flt(riff_str *s) {
-    char *end;
-    return riff_strtod(s->str, &end, 0);
+// Return a NUL-terminated pointer to the contents of a string, copying them
+// if `s` is a view which has since been appended to
+static inline char *riff_str_cstr(riff_str *s) {
+    if (riff_unlikely(s->str[s->len]))
+        riff_str_flatten(s);
+    return s->str;
 }
 
 void        re_register_fldv(riff_tab *);
 riff_regex *re_compile(char *, size_t, uint32_t, int *);
+riff_regex *re_compile_cached(const char *, size_t, uint32_t, int *);
+void        re_jit_compile(riff_regex *);
 void        re_free(riff_regex *);
-int         re_store_numbered_captures(pcre2_match_data *);
+pcre2_match_context *re_match_context(void);
+pcre2_match_data    *re_match_data(riff_regex *);
+int         re_exec(riff_regex *, const char *, size_t, size_t, pcre2_match_data *);
+int         re_store_numbered_captures(pcre2_match_data *, const char *);
+void        re_flush_captures(void);
+void        re_set_record(const char *, PCRE2_SIZE *, uint32_t);
+void        re_touch_field(riff_int);
 riff_int    re_match(char *, size_t, riff_regex *, int);
 riff_val   *v_newnull(void);
-riff_val   *v_newtab(uint32_t);
+void        v_newtab(riff_val *, uint32_t);
 riff_val   *v_copy(riff_val *);
 
 #endif
@@ -2,14 +2,19 @@
 
 #include "code.h"
 #include "conf.h"
+#include "gc.h"
+#include "jit.h"
 #include "lib.h"
 #include "mem.h"
 #include "string.h"
 #include "util.h"
 
+#include <ctype.h>
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 static inline void err(const char *msg) {
     fprintf(stderr, "riff: [vm] %s\n", msg);
@@ -23,6 +28,23 @@ static riff_tab   argv;
 static riff_tab   fldv;
 static vm_iter   *iter = NULL;
 static vm_stack   stack[VM_STACK_SIZE];
+static vm_stack  *vm_top = stack; // Stack top as of the last GC safe point
+static vm_stack  *ref_top = stack; // Bound on slots holding table addresses
+static riff_tab  *owner[VM_STACK_SIZE]; // Owners of VM_ELEM addresses, by slot
+
+#ifdef VM_COUNT_INSNS
+static uint64_t insn_count = 0;
+static void print_insn_count(void) {
+    fprintf(stderr, "riff: %"PRIu64" instructions executed\n", insn_count);
+}
+#define COUNT_INSN() ++insn_count
+#else
+#define COUNT_INSN()
+#endif
+
+// States whose code is currently executing (main program and any eval()
+// calls in progress)
+static RIFF_VEC(riff_state *) states;
 
 static inline void new_iter(riff_val *set, int kind) {
     vm_iter *new = malloc(sizeof(vm_iter));
@@ -50,7 +72,8 @@ static inline void new_iter(riff_val *set, int kind) {
     case TYPE_STR:
         iter->t = LOOP_STR_KV + kind;
         iter->n = riff_strlen(set->s);
-        iter->str = set->s->str;
+        iter->off = 0;
+        iter->s = set->s;
         break;
     case TYPE_REGEX:
         err("cannot iterate over regular expression");
@@ -102,7 +125,60 @@ static inline void init_argv(riff_tab *t, riff_int arg0, int rf_argc, char **rf_
     }
 }
 
-static inline int exec(uint8_t *, riff_val *, vm_stack *, vm_stack *);
+static inline int exec(riff_code *, vm_stack *, vm_stack *);
+
+// Redirect any addresses on the stack pointing into the `n` values at `from`
+// to the same offset in `to`. Called by tables when relocating values.
+void riff_vm_rebase(riff_val *from, size_t n, riff_val *to) {
+    uintptr_t lo = (uintptr_t) from;
+    uintptr_t sz = n * sizeof(riff_val);
+    for (vm_stack *p = stack; p < ref_top; ++p) {
+        if ((p->t == VM_ELEM || p->t == VM_ADDR) && (uintptr_t) p->a - lo < sz)
+            p->a = to + ((uintptr_t) p->a - lo) / sizeof(riff_val);
+    }
+}
+
+void riff_vm_mark_roots(void) {
+    for (vm_stack *p = stack; p < vm_top; ++p) {
+        switch (p->t) {
+        // Variable addresses point into the stack or the globals table, both
+        // of which are scanned anyway
+        case VM_ADDR:
+            break;
+        // Table elements must stay valid until the VM is done with them, even
+        // if the table itself becomes unreachable, so the owner is marked
+        case VM_ELEM:
+            riff_gc_mark_tab(owner[p - stack]);
+            break;
+        default:
+            riff_gc_mark_val(&p->v);
+            break;
+        }
+    }
+    riff_htab_traverse_str(&globals);
+    riff_tab_traverse(&argv);
+    riff_tab_traverse(&fldv);
+    for (vm_iter *it = iter; it; it = it->p) {
+        switch (it->t) {
+        case LOOP_STR_KV:
+        case LOOP_STR_V:
+            riff_gc_mark_str(it->s);
+            break;
+        case LOOP_TAB_KV:
+        case LOOP_TAB_V:
+            riff_gc_mark_tab(it->tab);
+            for (riff_uint i = 0; i < it->n; ++i)
+                riff_gc_mark_val(&it->kp[i]);
+            break;
+        default:
+            break;
+        }
+    }
+    RIFF_VEC_FOREACH(&states, i) {
+        riff_fn *main = &RIFF_VEC_GET(&states, i)->main;
+        riff_gc_mark_val(&(riff_val) {TYPE_RFN, .fn = main});
+    }
+}
 
 #define add_user_funcs()                                                           \
     RIFF_VEC_FOREACH((&state->global_fn), i) {                                     \
@@ -119,6 +195,141 @@ static inline void register_lib(void) {
     riff_lib_register_str(&globals);
 }
 
+// Record loop (-n/-p)
+// The main chunk is run once per input record (line), with the record in $0
+// and its fields in $1, $2, etc., the number of fields in `nf` and the record
+// number in `nr`. Records are split on runs of whitespace by default (as with
+// split()), or on the separator given with -F: a single character, or a
+// regular expression if longer. BEGIN() and END(), if the program defines
+// them, are called before the first record and after the last.
+
+static PCRE2_SIZE *rec_ov = NULL;
+static uint32_t    rec_ov_cap = 0;
+
+static inline void add_field(uint32_t *n, PCRE2_SIZE l, PCRE2_SIZE r) {
+    if (riff_unlikely(*n == rec_ov_cap)) {
+        rec_ov_cap = rec_ov_cap ? rec_ov_cap * 2 : 32;
+        rec_ov = realloc(rec_ov, 2 * rec_ov_cap * sizeof *rec_ov);
+    }
+    rec_ov[2 * *n]     = l;
+    rec_ov[2 * *n + 1] = r;
+    ++*n;
+}
+
+// Fill `rec_ov` with the offsets of the record and its fields, returning the
+// number of pairs
+static uint32_t split_record(const char *s, size_t len, const char *fs, riff_regex *re) {
+    uint32_t n = 0;
+    add_field(&n, 0, len);
+    if (!len)
+        return n;
+    if (re != NULL) {
+        pcre2_match_data *md = re_match_data(re);
+        size_t start = 0;
+        while (start < len && re_exec(re, s, len, start, md) > 0) {
+            PCRE2_SIZE *ov = pcre2_get_ovector_pointer(md);
+            if (ov[1] == ov[0])
+                break;
+            add_field(&n, start, ov[0]);
+            start = ov[1];
+        }
+        add_field(&n, start, len);
+    } else if (fs != NULL) {
+        const char *p = s, *end = s + len, *q;
+        while ((q = memchr(p, *fs, end - p)) != NULL) {
+            add_field(&n, p - s, q - s);
+            p = q + 1;
+        }
+        add_field(&n, p - s, len);
+    } else {
+        size_t i = 0;
+        while (1) {
+            while (i < len && isspace((unsigned char) s[i]))
+                ++i;
+            if (i == len)
+                break;
+            size_t j = i;
+            while (j < len && !isspace((unsigned char) s[j]))
+                ++j;
+            add_field(&n, i, j);
+            i = j;
+        }
+    }
+    return n;
+}
+
+// Fields the program assigns to are cleared with the next record. Keys are
+// reduced the same way the fields table reduces them.
+static inline void touch_field(riff_val *k) {
+    switch (k->type) {
+    case TYPE_INT:
+        re_touch_field(k->i);
+        break;
+    case TYPE_FLOAT:
+        if (k->f >= 0 && k->f < UINT32_MAX && k->f == (uint32_t) k->f)
+            re_touch_field((riff_int) k->f);
+        break;
+    case TYPE_STR:
+        if (riff_str_coercible(k->s) && (riff_str_num(k->s) & RIFF_STR_HINT_INT))
+            re_touch_field(k->s->num.i);
+        break;
+    default:
+        break;
+    }
+}
+
+static void call_global(const char *name) {
+    riff_val *fn = riff_htab_insert_cstr(&globals, name, &(riff_val) {TYPE_NULL});
+    if (is_rfn(fn)) {
+        int arity = fn->fn->arity;
+        stack[0].v = *fn;
+        for (int i = 1; i <= arity; ++i)
+            set_null(&stack[i].v);
+        exec(&fn->fn->code, stack + arity + 1, stack);
+    }
+}
+
+static int exec_records(riff_state *state) {
+    const char *fs = state->rec_fs;
+    riff_regex *re = NULL;
+    if (fs != NULL && !strcmp(fs, " ")) {
+        fs = NULL;
+    } else if (fs != NULL && strlen(fs) > 1) {
+        int errcode;
+        re = re_compile((char *) fs, strlen(fs), 0, &errcode);
+        if (re == NULL) {
+            PCRE2_UCHAR errstr[0x200];
+            pcre2_get_error_message(errcode, errstr, 0x200);
+            fprintf(stderr, "riff: -F: %s\n", (char *) errstr);
+            exit(1);
+        }
+        re_jit_compile(re);
+    } else if (fs != NULL && !*fs) {
+        fs = NULL;
+    }
+    riff_val *nr = riff_htab_insert_cstr(&globals, "nr", &(riff_val) {TYPE_INT, .i = 0});
+    riff_val *nf = riff_htab_insert_cstr(&globals, "nf", &(riff_val) {TYPE_INT, .i = 0});
+    riff_int nrec = 0;
+    riff_io_set_input(state->argv + state->rec_argi, state->argc - state->rec_argi);
+    call_global("BEGIN");
+    const char *s;
+    size_t len;
+    while ((s = riff_io_next_record(&len)) != NULL) {
+        uint32_t n = split_record(s, len, fs, re);
+        re_set_record(s, rec_ov, n);
+        set_int(nr, ++nrec);
+        set_int(nf, n - 1);
+        exec(&state->main.code, stack, stack);
+        if (state->rec_mode == REC_PRINT) {
+            re_flush_captures();
+            riff_out_val(riff_tab_lookup(&fldv, &(riff_val) {TYPE_INT, .i = 0}));
+            riff_out_write("\n", 1);
+        }
+    }
+    call_global("END");
+    return 0;
+}
+
 // VM entry point/initialization
 int riff_exec(riff_state *state) {
     riff_htab_init(&globals);
@@ -129,14 +340,23 @@ int riff_exec(riff_state *state) {
     register_lib();
     // Add user-defined functions to the global hash table
     add_user_funcs();
-    return exec(state->main.code.code, state->main.code.k, stack, stack);
+    riff_vec_add(&states, state);
+#ifdef VM_COUNT_INSNS
+    atexit(print_insn_count);
+#endif
+    if (state->rec_mode != REC_NONE)
+        return exec_records(state);
+    return exec(&state->main.code, stack, stack);
 }
 
 // Reentry point for eval()
 int riff_exec_reenter(riff_state *state, vm_stack *fp) {
     // Add user-defined functions to the global hash table
     add_user_funcs();
-    return exec(state->main.code.code, state->main.code.k, fp, fp);
+    riff_vec_add(&states, state);
+    int ret = exec(&state->main.code, fp, fp);
+    states.n--;
+    return ret;
 }
 
 #ifndef COMPUTED_GOTO
@@ -151,22 +371,72 @@ int riff_exec_reenter(riff_state *state, vm_stack *fp) {
 #else
 #define L(l)       L_##l
 #define BREAK      DISPATCH()
-#define DISPATCH() goto *dispatch_labels[*ip]
+#define DISPATCH() do { COUNT_INSN(); goto *dispatch_labels[*ip]; } while (0)
+#endif
+
+// Assign address x to vm_stack *p
+#define set_addr(p, x) *(p) = (vm_stack) {{VM_ADDR, (x)}}
+#define set_elem(p, x, t)                           \
+    do {                                            \
+        track_ref(p);                               \
+        owner[(p) - stack] = (t);                   \
+        *(p) = (vm_stack) {{VM_ELEM, (x)}};         \
+    } while (0)
+
+// Table elements can be relocated while their addresses are on the stack;
+// `ref_top` bounds the slots riff_vm_rebase() needs to check. Stale slots
+// above the stack top are harmless to rewrite. The bound is lowered as calls
+// return, since the callee's slots are dead by then.
+#define track_ref(p)   if ((p) >= ref_top) ref_top = (p) + 1
+#define untrack_refs(p) if ((p) < ref_top) ref_top = (p)
+
+// Let the garbage collector perform a step if it's due. Safe points are
+// placed at function entry and backward jumps, bounding the amount of
+// allocation possible between them.
+#define GC_SAFEPOINT()                         \
+    if (riff_unlikely(riff_gc_debt > 0)) {     \
+        vm_top = sp;                           \
+        riff_gc_step();                        \
+    }
+
+#ifdef RIFF_JIT
+// Enter native code at IP if the current code object has been compiled.
+// Otherwise, count toward compiling it. Like GC safe points, these are placed
+// at function entry and backward jumps.
+#define JIT_ENTER()                                                 \
+    if (riff_unlikely(riff_jit_enabled)) {                          \
+        if (c->jit) {                                               \
+            if (c->jit->map[ip - ep] >= 0) {                        \
+                vm_stack *jsp = sp;                                 \
+                ip = ep + riff_jit_exec(c->jit, ip - ep, &jsp, fp); \
+                sp = jsp;                                           \
+            }                                                       \
+        } else if (++c->hot >= JIT_HOT_COUNT) {                     \
+            riff_jit_compile(c);                                    \
+        }                                                           \
+    }
+#else
+#define JIT_ENTER()
 #endif
 
 // VM interpreter loop
-static inline int exec(uint8_t *ep, riff_val *k, vm_stack *sp, vm_stack *fp) {
+static inline int exec(riff_code *c, vm_stack *sp, vm_stack *fp) {
     if (riff_unlikely(sp - stack >= VM_STACK_SIZE)) {
         err("stack overflow");
     }
+    GC_SAFEPOINT();
     vm_stack *retp = sp; // Save original SP
     riff_val *tp;        // Temp pointer
+    uint8_t   *ep = c->code;
+    riff_val  *k  = c->k;
+    riff_val **gk = c->gk;
     register uint8_t *ip = ep;
+    JIT_ENTER();
 
 #ifndef COMPUTED_GOTO
     // Use standard while loop with switch/case if computed goto is disabled or
     // unavailable
-    while (1) { switch (*ip) {
+    while (1) { COUNT_INSN(); switch (*ip) {
 #else
     static void *dispatch_labels[] = {
 #define LABEL_ENUM(s,a)   &&L_##s,
@@ -179,16 +449,33 @@ static inline int exec(uint8_t *ep, riff_val *k, vm_stack *sp, vm_stack *fp) {
 #define JUMP8()  (ip +=  (int8_t)     ip[1])
 #define JUMP16() (ip += *(int16_t *) &ip[1])
 
-L(JMP):     JUMP8();  BREAK;
-L(JMP16):   JUMP16(); BREAK;
+// 8-bit jumps are only ever emitted for backward jumps
+L(JMP):     GC_SAFEPOINT();
+            JUMP8();
+            JIT_ENTER();
+            BREAK;
+L(JMP16):   if (*(int16_t *) &ip[1] < 0) {
+                GC_SAFEPOINT();
+                JUMP16();
+                JIT_ENTER();
+            } else {
+                JUMP16();
+            }
+            BREAK;
 
 // Conditional jumps (pop stack unconditionally)
 #define JUMPCOND8(x)  (x ? JUMP8()  : (ip += 2)); --sp
 #define JUMPCOND16(x) (x ? JUMP16() : (ip += 3)); --sp
 
-L(JNZ):     JUMPCOND8(riff_op_test(&sp[-1].v));   BREAK;
+L(JNZ):     GC_SAFEPOINT();
+            JUMPCOND8(riff_op_test(&sp[-1].v));
+            JIT_ENTER();
+            BREAK;
 L(JNZ16):   JUMPCOND16(riff_op_test(&sp[-1].v));  BREAK;
-L(JZ):      JUMPCOND8(!riff_op_test(&sp[-1].v));  BREAK;
+L(JZ):      GC_SAFEPOINT();
+            JUMPCOND8(!riff_op_test(&sp[-1].v));
+            JIT_ENTER();
+            BREAK;
 L(JZ16):    JUMPCOND16(!riff_op_test(&sp[-1].v)); BREAK;
 
 
@@ -204,6 +491,7 @@ L(XJZ16):   XJUMPCOND16(!riff_op_test(&sp[-1].v)); BREAK;
 // Initialize/cycle current iterator
 L(LOOP):
 L(LOOP16): {
+    GC_SAFEPOINT();
     int jmp16 = *ip - OP_LOOP;
     if (riff_unlikely(!iter->n--)) {
         ip += 2 + jmp16;
@@ -228,11 +516,13 @@ L(LOOP16): {
         else
             set_int(iter->k, 0);
         // Fall-through
+    // The string's bytes are read through `s` each time, since a view may be
+    // given a new buffer by riff_str_cstr() during the loop
     case LOOP_STR_V:
         if (riff_likely(is_str(iter->v)))
-            iter->v->s = riff_str_new(iter->str++, 1);
+            iter->v->s = riff_str_new(iter->s->str + iter->off++, 1);
         else
-            *iter->v = (riff_val) {TYPE_STR, .s = riff_str_new(iter->str++, 1)};
+            *iter->v = (riff_val) {TYPE_STR, .s = riff_str_new(iter->s->str + iter->off++, 1)};
         break;
     case LOOP_TAB_KV:
         *iter->k = *iter->kp;
@@ -247,6 +537,7 @@ L(LOOP16): {
     // Treat byte(s) following OP_LOOP as unsigned since jumps are always
     // backward
     ip -= jmp16 ? *(uint16_t *) &ip[1] : ip[1];
+    JIT_ENTER();
     BREAK;
 }
 
@@ -298,9 +589,25 @@ L(NUM):     UNARYOP(num);  BREAK;
         ++ip;                              \
     } while (0)
 
-L(ADD):     BINOP(add);    BREAK;
-L(SUB):     BINOP(sub);    BREAK;
-L(MUL):     BINOP(mul);    BREAK;
+// Generic instructions with quickened variants (see below) rewrite themselves
+// once both operands are integers or both are floats
+#define QUICKEN(l, r, x)                            \
+    do {                                            \
+        if (is_int(l) && is_int(r))                 \
+            *ip = OP_I##x;                          \
+        else if (is_float(l) && is_float(r))        \
+            *ip = OP_F##x;                          \
+    } while (0)
+
+#define QBINOP(x, y)                                \
+    do {                                            \
+        QUICKEN(&sp[-2].v, &sp[-1].v, x);           \
+        BINOP(y);                                   \
+    } while (0)
+
+L(ADD):     QBINOP(ADD, add); BREAK;
+L(SUB):     QBINOP(SUB, sub); BREAK;
+L(MUL):     QBINOP(MUL, mul); BREAK;
 L(DIV):     BINOP(div);    BREAK;
 L(MOD):     BINOP(mod);    BREAK;
 L(POW):     BINOP(pow);    BREAK;
@@ -309,12 +616,12 @@ L(OR):      BINOP(or);     BREAK;
 L(XOR):     BINOP(xor);    BREAK;
 L(SHL):     BINOP(shl);    BREAK;
 L(SHR):     BINOP(shr);    BREAK;
-L(EQ):      BINOP(eq);     BREAK;
-L(NE):      BINOP(ne);     BREAK;
-L(GT):      BINOP(gt);     BREAK;
-L(GE):      BINOP(ge);     BREAK;
-L(LT):      BINOP(lt);     BREAK;
-L(LE):      BINOP(le);     BREAK;
+L(EQ):      QBINOP(EQ, eq); BREAK;
+L(NE):      QBINOP(NE, ne); BREAK;
+L(GT):      QBINOP(GT, gt); BREAK;
+L(GE):      QBINOP(GE, ge); BREAK;
+L(LT):      QBINOP(LT, lt); BREAK;
+L(LE):      QBINOP(LE, le); BREAK;
 L(MATCH):   BINOP(match);  BREAK;
 L(NMATCH):  BINOP(nmatch); BREAK;
 L(CAT):     BINOP(cat);    BREAK;
@@ -326,24 +633,31 @@ L(CATI):    riff_op_catn(sp, ip[1]);
 
 L(VIDXV):   BINOP(idx);    BREAK;
 
+// Increment/decrement the riff_val at address p by x, coercing non-numeric
+// values
+#define INCR(p, x)                             \
+    do {                                       \
+        switch ((p)->type) {                   \
+        case TYPE_INT: (p)->i += x; break;     \
+        case TYPE_FLOAT: (p)->f += x; break;   \
+        case TYPE_STR:                         \
+            set_flt((p), str2flt((p)->s) + x); \
+            break;                             \
+        default:                               \
+            set_int((p), x);                   \
+            break;                             \
+        }                                      \
+    } while (0)
+
 // Pre-increment/decrement
 // sp[-1].a is address of some variable's riff_val.
 // Increment/decrement this value directly and replace the stack element with a
 // copy of the value.
-#define PRE(x)                                           \
-    do {                                                 \
-        switch (sp[-1].a->type) {                        \
-        case TYPE_INT: sp[-1].a->i += x; break;          \
-        case TYPE_FLOAT: sp[-1].a->f += x; break;        \
-        case TYPE_STR:                                   \
-            set_flt(sp[-1].a, str2flt(sp[-1].a->s) + x); \
-            break;                                       \
-        default:                                         \
-            set_int(sp[-1].a, x);                        \
-            break;                                       \
-        }                                                \
-        sp[-1].v = *sp[-1].a;                            \
-        ++ip;                                            \
+#define PRE(x)                     \
+    do {                           \
+        INCR(sp[-1].a, x);         \
+        sp[-1].v = *sp[-1].a;      \
+        ++ip;                      \
     } while (0)
 
 L(PREINC):  PRE(1);  BREAK;
@@ -354,21 +668,12 @@ L(PREDEC):  PRE(-1); BREAK;
 // value, then increment/decrement the riff_val at the given address. Replace the
 // stack element with the previously made copy and coerce to a numeric value if
 // needed.
-#define POST(x)                              \
-    do {                                     \
-        tp = sp[-1].a;                       \
-        sp[-1].v = *tp;                      \
-        switch (tp->type) {                  \
-        case TYPE_INT: tp->i += x; break;    \
-        case TYPE_FLOAT: tp->f += x; break;  \
-        case TYPE_STR:                       \
-            set_flt(tp, str2flt(tp->s) + x); \
-            break;                           \
-        default:                             \
-            set_int(tp, x);                  \
-            break;                           \
-        }                                    \
-        UNARYOP(num);                        \
+#define POST(x)                    \
+    do {                           \
+        tp = sp[-1].a;             \
+        sp[-1].v = *tp;            \
+        INCR(tp, x);               \
+        UNARYOP(num);              \
     } while (0)
 
 L(POSTINC): POST(1);  BREAK;
@@ -391,7 +696,7 @@ L(SUBX):    COMPOUNDBINOP(sub); BREAK;
 L(MULX):    COMPOUNDBINOP(mul); BREAK;
 L(DIVX):    COMPOUNDBINOP(div); BREAK;
 L(MODX):    COMPOUNDBINOP(mod); BREAK;
-L(CATX):    COMPOUNDBINOP(cat); BREAK;
+L(CATX):    COMPOUNDBINOP(catx); BREAK;
 L(POWX):    COMPOUNDBINOP(pow); BREAK;
 L(ANDX):    COMPOUNDBINOP(and); BREAK;
 L(ORX):     COMPOUNDBINOP(or);  BREAK;
@@ -432,13 +737,20 @@ L(CONST0):  PUSHCONST(0);     ++ip;    BREAK;
 L(CONST1):  PUSHCONST(1);     ++ip;    BREAK;
 L(CONST2):  PUSHCONST(2);     ++ip;    BREAK;
 
+// Resolve the address of global variable x. The first lookup through a given
+// code object is cached in its global cache; globals are never removed and
+// their values never move, so the cached address stays valid for the life of
+// the program.
+#define GLOBAL(x) \
+    (riff_likely(gk[(x)] != NULL) ? gk[(x)] \
+        : (gk[(x)] = riff_htab_lookup_str(&globals, k[(x)].s)))
+
 // Push global address
 // Assign the address of global variable x's riff_val in the globals table.
 // The lookup will create an entry if needed, accommodating
 // undeclared/uninitialized variable usage.
 // Compiler emits this opcode for assignment or pre/post ++/--.
-#define PUSHGLOBALADDR(x) \
-    sp++->a = riff_htab_lookup_str(&globals, k[(x)].s)
+#define PUSHGLOBALADDR(x) set_addr(sp++, GLOBAL(x))
 
 L(GBLA):    PUSHGLOBALADDR(ip[1]); ip += 2; BREAK;
 L(GBLA0):   PUSHGLOBALADDR(0);     ++ip;    BREAK;
@@ -450,8 +762,7 @@ L(GBLA2):   PUSHGLOBALADDR(2);     ++ip;    BREAK;
 // The lookup will create an entry if needed, accommodating
 // undeclared/uninitialized variable usage.
 // Compiler emits this opcode when only needing the value, e.g. arithmetic.
-#define PUSHGLOBALVAL(x) \
-    sp++->v = *riff_htab_lookup_str(&globals, k[(x)].s)
+#define PUSHGLOBALVAL(x) sp++->v = *GLOBAL(x)
 
 L(GBLV):    PUSHGLOBALVAL(ip[1]); ip += 2; BREAK;
 L(GBLV0):   PUSHGLOBALVAL(0);     ++ip;    BREAK;
@@ -460,7 +771,7 @@ L(GBLV2):   PUSHGLOBALVAL(2);     ++ip;    BREAK;
 
 // Push local address
 // Push the address of FP[x] to the top of the stack.
-#define PUSHLOCALADDR(x) sp++->a = &fp[(x)].v
+#define PUSHLOCALADDR(x) set_addr(sp++, &fp[(x)].v)
 
 L(LCLA):    PUSHLOCALADDR(ip[1]); ip += 2; BREAK;
 L(LCLA0):   PUSHLOCALADDR(0);     ++ip;    BREAK;
@@ -468,7 +779,7 @@ L(LCLA1):   PUSHLOCALADDR(1);     ++ip;    BREAK;
 L(LCLA2):   PUSHLOCALADDR(2);     ++ip;    BREAK;
 
 L(DUPA):    set_null(&sp->v);
-            sp[1].a = &sp->v;
+            set_addr(&sp[1], &sp->v);
             sp += 2;
             ++ip;
             BREAK;
@@ -509,6 +820,7 @@ L(TCALL): {
         // quickly reset IP and dispatch control
         if (ep == fn->code.code && ar1 == ar2) {
             ip = ep;
+            JIT_ENTER();
             BREAK;
         }
 
@@ -529,8 +841,11 @@ L(TCALL): {
             while (nargs++ <= ar2)
                 set_null(&sp++->v);
 
-        ip = ep = fn->code.code;
-        k  = fn->code.k;
+        c  = &fn->code;
+        ip = ep = c->code;
+        k  = c->k;
+        gk = c->gk;
+        JIT_ENTER();
         BREAK;
     }
     // Fall-through to OP_CALL for C function calls
@@ -571,7 +886,7 @@ L(CALL): {
         // to itself without any other work required from the VM here. This is
         // completely necessary for local named functions, but globals benefit
         // as well.
-        nret = exec(fn->code.code, fn->code.k, sp, sp - arity - 1);
+        nret = exec(&fn->code, sp, sp - arity - 1);
         sp -= arity;
 
         // Copy the function's return value to the stack top - this should be
@@ -597,6 +912,7 @@ L(CALL): {
         sp -= nargs;
         nret = fn->fn(&sp->v, nargs);
     }
+    untrack_refs(sp);
     ip += 2;
     // Nulllify stack slot if callee returns nothing
     if (!nret)
@@ -614,14 +930,15 @@ L(RET1):    retp->v = sp[-1].v;
 
 // Create a sequential table of x elements from the top of the stack. Leave the
 // table riff_val on the stack. Tables index at 0 by default.
-#define INITTABLE(x)                               \
-    do {                                           \
-        tp = v_newtab(x);                          \
-        for (int i = (x) - 1; i >= 0; --i) {       \
-            --sp;                                  \
-            riff_tab_insert_int(tp->t, i, &sp->v); \
-        }                                          \
-        sp++->v = *tp;                             \
+#define INITTABLE(x)                              \
+    do {                                          \
+        riff_val t;                               \
+        v_newtab(&t, x);                          \
+        for (int i = (x) - 1; i >= 0; --i) {      \
+            --sp;                                 \
+            riff_tab_insert_int(t.t, i, &sp->v);  \
+        }                                         \
+        sp++->v = t;                              \
     } while (0)
 
 L(TAB0):    INITTABLE(0);          ++ip;    BREAK;
@@ -634,11 +951,11 @@ L(IDXA): {
         switch (sp[i].a->type) {
         // Create table if sp[i].a is an uninitialized variable
         case TYPE_NULL:
-            *sp[i].a = *v_newtab(0);
+            v_newtab(sp[i].a, 0);
             // Fall-through
         case TYPE_TAB:
             sp[i].a->t->hint = 1;
-            sp[i+1].a = riff_tab_lookup(sp[i].a->t, &sp[i+1].v);
+                set_elem(&sp[i+1], riff_tab_lookup(sp[i].a->t, &sp[i+1].v), sp[i].a->t);
             break;
         // IDXA is invalid for all other types
         default:
@@ -646,7 +963,8 @@ L(IDXA): {
         }
     }
     sp -= ip[1];
-    sp[-1].a = sp[ip[1]-1].a;
+    sp[-1] = sp[ip[1]-1];
+    owner[sp - 1 - stack] = owner[sp + ip[1] - 1 - stack];
     ip += 2;
     BREAK;
 }
@@ -654,7 +972,7 @@ L(IDXA): {
 L(IDXV): {
     int i = -ip[1] - 1;
     if (is_null(sp[i].a))
-        *sp[i].a = *v_newtab(0);
+        v_newtab(sp[i].a, 0);
     sp[i].v = *sp[i].a;
     for (; i < -1; ++i) {
         riff_op_idx(&sp[i].v, &sp[i+1].v);
@@ -673,11 +991,11 @@ L(IDXA1):
     switch (sp[-2].a->type) {
     // Create table if sp[-2].a is an uninitialized variable
     case TYPE_NULL:
-        *sp[-2].a = *v_newtab(0);
+        v_newtab(sp[-2].a, 0);
         // Fall-through
     case TYPE_TAB:
         sp[-2].a->t->hint = 1;
-        sp[-2].a = riff_tab_lookup(sp[-2].a->t, &sp[-1].v);
+        set_elem(&sp[-2], riff_tab_lookup(sp[-2].a->t, &sp[-1].v), sp[-2].a->t);
         break;
     // IDXA is invalid for all other types
     default:
@@ -691,27 +1009,24 @@ L(IDXA1):
 // Perform the lookup and leave a copy of the corresponding element's value on
 // the stack.
 L(IDXV1):
+idxv1:
     switch (sp[-2].a->type) {
     // Create table if sp[-2].a is an uninitialized variable
     case TYPE_NULL:
-        *sp[-2].a = *v_newtab(0);
+        v_newtab(sp[-2].a, 0);
         // Fall-through
     case TYPE_TAB:
         sp[-2].v = *riff_tab_lookup(sp[-2].a->t, &sp[-1].v);
         --sp;
         ++ip;
         break;
-    // Dereference and call riff_op_idx().
-    case TYPE_INT:
-    case TYPE_FLOAT:
-    case TYPE_STR:
-        sp[-2].v = *sp[-2].a;
-        BINOP(idx);
-        break;
     case TYPE_RFN:
     case TYPE_CFN:
         err("invalid function subscript");
+    // Dereference and call riff_op_idx().
     default:
+        sp[-2].v = *sp[-2].a;
+        BINOP(idx);
         break;
     }
     BREAK;
@@ -721,10 +1036,10 @@ L(SIDXA):
     switch (sp[-1].a->type) {
     // Create table if sp[-1].a is an uninitialized variable
     case TYPE_NULL:
-        *sp[-1].a = *v_newtab(0);
+        v_newtab(sp[-1].a, 0);
         // Fall-through
     case TYPE_TAB:
-        sp[-1].a = riff_htab_lookup_val(sp[-1].a->t->h, &k[ip[1]]);
+        set_elem(&sp[-1], riff_htab_lookup_val(sp[-1].a->t->h, &k[ip[1]]), sp[-1].a->t);
         break;
     default:
         err("invalid member access (non-table value)");
@@ -736,7 +1051,7 @@ L(SIDXV):
     switch (sp[-1].a->type) {
     // Create table if sp[-1].a is an uninitialized variable
     case TYPE_NULL:
-        *sp[-1].a = *v_newtab(0);
+        v_newtab(sp[-1].a, 0);
         // Fall-through
     case TYPE_TAB:
         sp[-1].v = *riff_htab_lookup_val(sp[-1].a->t->h, &k[ip[1]]);
@@ -747,12 +1062,16 @@ L(SIDXV):
     ip += 2;
     BREAK;
 
-L(FLDA):    sp[-1].a = riff_tab_lookup(&fldv, &sp[-1].v);
+L(FLDA):    re_flush_captures();
+            touch_field(&sp[-1].v);
+            track_ref(&sp[-1]);
+            set_addr(&sp[-1], riff_tab_lookup(&fldv, &sp[-1].v));
             fldv.hint = 1;
             ++ip;
             BREAK;
 
-L(FLDV):    sp[-1].v = *riff_tab_lookup(&fldv, &sp[-1].v);
+L(FLDV):    re_flush_captures();
+            sp[-1].v = *riff_tab_lookup(&fldv, &sp[-1].v);
             ++ip;
             BREAK;
 
@@ -770,7 +1089,8 @@ L(FLDV):    sp[-1].v = *riff_tab_lookup(&fldv, &sp[-1].v);
 // Otherwise, the interval is set to 1 (upward ranges).
 #define PUSHRANGE(f,t,i,s)                                \
     do {                                                  \
-        riff_range *r = malloc(sizeof(riff_range));       \
+        riff_range *r = riff_gc_new(sizeof(riff_range),   \
+                                    GC_OBJ_RANGE);        \
         riff_int from = r->from = (f);                    \
         riff_int to   = r->to = (t);                      \
         riff_int itvl = (i);                              \
@@ -825,17 +1145,268 @@ L(SRNGI):   PUSHRANGE(0, INT64_MAX, intval(&sp[-1].v), sp[-1].v);
 
 // Simple assignment
 // copy SP[-1] to *SP[-2] and leave value on stack.
-L(SET):     sp[-2].v = *sp[-2].a = sp[-1].v;
+// The owner of the destination isn't known (it may have been blackened after
+// its element address was pushed), so the stored value is marked outright
+// while the collector is marking.
+L(SET):     riff_gc_barrier_fwd(&sp[-1].v);
+            sp[-2].v = *sp[-2].a = sp[-1].v;
             --sp;
             ++ip;
             BREAK;
 
 // Set and pop
-L(SETP):    *sp[-2].a = sp[-1].v;
+L(SETP):    riff_gc_barrier_fwd(&sp[-1].v);
+            *sp[-2].a = sp[-1].v;
             sp -= 2;
             ++ip;
             BREAK;
 
+// Superinstructions
+// Fused forms of common instruction sequences, emitted by the compiler's
+// peephole optimizer.
+
+// ++/-- statements on locals and globals
+//   LCLA x; PREINC|POSTINC; POP => INCL x
+L(INCL):    INCR(&fp[ip[1]].v, 1);  ip += 2; BREAK;
+L(DECL):    INCR(&fp[ip[1]].v, -1); ip += 2; BREAK;
+L(INCG):    INCR(GLOBAL(ip[1]), 1);  ip += 2; BREAK;
+L(DECG):    INCR(GLOBAL(ip[1]), -1); ip += 2; BREAK;
+
+// LCLV x; LCLV y; ADD => ADDLL x y
+L(ADDLL):   sp->v = fp[ip[1]].v;
+            riff_op_add(&sp++->v, &fp[ip[2]].v);
+            ip += 3;
+            BREAK;
+
+// LCLA x; LCLV y; ADDX; POP => ADDXLL x y
+L(ADDXLL): {
+    riff_val v = fp[ip[2]].v;
+    riff_op_add(&fp[ip[1]].v, &v);
+    ip += 3;
+    BREAK;
+}
+
+// LCLA x; LCLV y; IDXV1 => IDXVLL x y
+// Both operands are placed on the stack for IDXV1, with IP set such that IDXV1
+// steps over the fused instruction.
+L(IDXVLL):  set_addr(sp, &fp[ip[1]].v);
+            sp[1].v = fp[ip[2]].v;
+            sp += 2;
+            ip += 2;
+            goto idxv1;
+
+// Compare-and-branch
+// Compare l and r, popping n stack elements, and jump if the result is false.
+// Otherwise, step over the w-byte instruction.
+#define CMPJZ(x, op, l, r, n, w)                            \
+    do {                                                    \
+        int t;                                              \
+        if (is_int(l) && is_int(r)) {                       \
+            t = (l)->i op (r)->i;                           \
+        } else {                                            \
+            riff_op_##x((l), (r));                          \
+            t = riff_op_test(l);                            \
+        }                                                   \
+        sp -= (n);                                          \
+        t ? (ip += (w)) : JUMP16();                         \
+    } while (0)
+
+// <cmp>; JZ16 => <cmp>JZ
+#define CMPJZS(q, x, op)                                    \
+    do {                                                    \
+        QUICKEN(&sp[-2].v, &sp[-1].v, q);                   \
+        CMPJZ(x, op, &sp[-2].v, &sp[-1].v, 2, 3);           \
+    } while (0)
+
+L(EQJZ):    CMPJZS(EQJZ, eq, ==); BREAK;
+L(NEJZ):    CMPJZS(NEJZ, ne, !=); BREAK;
+L(GTJZ):    CMPJZS(GTJZ, gt, >);  BREAK;
+L(GEJZ):    CMPJZS(GEJZ, ge, >=); BREAK;
+L(LTJZ):    CMPJZS(LTJZ, lt, <);  BREAK;
+L(LEJZ):    CMPJZS(LEJZ, le, <=); BREAK;
+
+// Register operands
+// The right operand is local x (..L) or the immediate x (..K) instead of
+// sp[-1].v. The left operand is sp[-1].v, which is overwritten with the result.
+#define BINOPL(x)                                 \
+    do {                                          \
+        riff_op_##x(&sp[-1].v, &fp[ip[1]].v);     \
+        ip += 2;                                  \
+    } while (0)
+
+#define BINOPK(x)                                 \
+    do {                                          \
+        riff_val k = (riff_val) {TYPE_INT, .i = ip[1]}; \
+        riff_op_##x(&sp[-1].v, &k);               \
+        ip += 2;                                  \
+    } while (0)
+
+L(ADDL):    QUICKEN(&sp[-1].v, &fp[ip[1]].v, ADDL); BINOPL(add); BREAK;
+L(ADDK):    BINOPK(add); BREAK;
+L(SUBL):    QUICKEN(&sp[-1].v, &fp[ip[1]].v, SUBL); BINOPL(sub); BREAK;
+L(SUBK):    BINOPK(sub); BREAK;
+L(MULL):    QUICKEN(&sp[-1].v, &fp[ip[1]].v, MULL); BINOPL(mul); BREAK;
+L(MULK):    BINOPK(mul); BREAK;
+L(DIVL):    BINOPL(div); BREAK;
+L(DIVK):    BINOPK(div); BREAK;
+L(MODL):    BINOPL(mod); BREAK;
+L(MODK):    BINOPK(mod); BREAK;
+L(ANDL):    BINOPL(and); BREAK;
+L(ANDK):    BINOPK(and); BREAK;
+L(ORL):     BINOPL(or);  BREAK;
+L(ORK):     BINOPK(or);  BREAK;
+L(XORL):    BINOPL(xor); BREAK;
+L(XORK):    BINOPK(xor); BREAK;
+L(SHLL):    BINOPL(shl); BREAK;
+L(SHLK):    BINOPK(shl); BREAK;
+L(SHRL):    BINOPL(shr); BREAK;
+L(SHRK):    BINOPK(shr); BREAK;
+L(CATL):    BINOPL(cat); BREAK;
+L(CATK):    BINOPK(cat); BREAK;
+L(EQL):     BINOPL(eq);  BREAK;
+L(EQK):     BINOPK(eq);  BREAK;
+L(NEL):     BINOPL(ne);  BREAK;
+L(NEK):     BINOPK(ne);  BREAK;
+L(GTL):     BINOPL(gt);  BREAK;
+L(GTK):     BINOPK(gt);  BREAK;
+L(GEL):     BINOPL(ge);  BREAK;
+L(GEK):     BINOPK(ge);  BREAK;
+L(LTL):     BINOPL(lt);  BREAK;
+L(LTK):     BINOPK(lt);  BREAK;
+L(LEL):     BINOPL(le);  BREAK;
+L(LEK):     BINOPK(le);  BREAK;
+
+// <cmp>L x; JZ16 => <cmp>LJZ x (likewise for ..K)
+// The jump offset is at ip[1], the operand at ip[3].
+#define CMPJZL(q, x, op)                                       \
+    do {                                                       \
+        QUICKEN(&sp[-1].v, &fp[ip[3]].v, q);                   \
+        CMPJZ(x, op, &sp[-1].v, &fp[ip[3]].v, 1, 4);           \
+    } while (0)
+#define CMPJZK(x, op)                                          \
+    do {                                                       \
+        riff_val k = (riff_val) {TYPE_INT, .i = ip[3]};        \
+        CMPJZ(x, op, &sp[-1].v, &k, 1, 4);                     \
+    } while (0)
+
+L(EQLJZ):   CMPJZL(EQLJZ, eq, ==); BREAK;
+L(EQKJZ):   CMPJZK(eq, ==); BREAK;
+L(NELJZ):   CMPJZL(NELJZ, ne, !=); BREAK;
+L(NEKJZ):   CMPJZK(ne, !=); BREAK;
+L(GTLJZ):   CMPJZL(GTLJZ, gt, >);  BREAK;
+L(GTKJZ):   CMPJZK(gt, >);  BREAK;
+L(GELJZ):   CMPJZL(GELJZ, ge, >=); BREAK;
+L(GEKJZ):   CMPJZK(ge, >=); BREAK;
+L(LTLJZ):   CMPJZL(LTLJZ, lt, <);  BREAK;
+L(LTKJZ):   CMPJZK(lt, <);  BREAK;
+L(LELJZ):   CMPJZL(LELJZ, le, <=); BREAK;
+L(LEKJZ):   CMPJZK(le, <=); BREAK;
+
+// Direct stores
+// Assign sp[-1].v to local or global x, leaving it on the stack (STL/STG) or
+// popping it (STLP/STGP). Both locations are roots, so no barrier is needed.
+L(STL):     fp[ip[1]].v = sp[-1].v;       ip += 2; BREAK;
+L(STLP):    fp[ip[1]].v = (--sp)->v;      ip += 2; BREAK;
+L(STG):     *GLOBAL(ip[1]) = sp[-1].v;    ip += 2; BREAK;
+L(STGP):    *GLOBAL(ip[1]) = (--sp)->v;   ip += 2; BREAK;
+
+// Quickened instructions
+// Integer (I..) and float (F..) variants skip type dispatch entirely while
+// their operands keep the types they were specialized for. Otherwise, they
+// revert to the generic instruction and dispatch it instead.
+#define QARITH(x, t, f, op, l, r, n, w)                     \
+    do {                                                    \
+        if (riff_likely((l)->type == t && (r)->type == t)) { \
+            (l)->f = (l)->f op (r)->f;                      \
+            sp -= (n);                                      \
+            ip += (w);                                      \
+        } else {                                            \
+            *ip = OP_##x;                                   \
+        }                                                   \
+    } while (0)
+
+// Comparisons yield integers, except float ==/!= (see CMP_EQ)
+#define QCMP(x, t, f, rt, rf, op)                           \
+    do {                                                    \
+        riff_val *l = &sp[-2].v, *r = &sp[-1].v;            \
+        if (riff_likely(l->type == t && r->type == t)) {    \
+            *l = (riff_val) {rt, .rf = l->f op r->f};       \
+            --sp;                                           \
+            ++ip;                                           \
+        } else {                                            \
+            *ip = OP_##x;                                   \
+        }                                                   \
+    } while (0)
+
+#define QCMPJZ(x, t, f, op, l, r, n, w)                     \
+    do {                                                    \
+        if (riff_likely((l)->type == t && (r)->type == t)) { \
+            int c = (l)->f op (r)->f;                       \
+            sp -= (n);                                      \
+            c ? (ip += (w)) : JUMP16();                     \
+        } else {                                            \
+            *ip = OP_##x;                                   \
+        }                                                   \
+    } while (0)
+
+#define QARITHS(x, t, f, op)  QARITH(x, t, f, op, &sp[-2].v, &sp[-1].v, 1, 1)
+#define QARITHL(x, t, f, op)  QARITH(x, t, f, op, &sp[-1].v, &fp[ip[1]].v, 0, 2)
+#define QCMPJZS(x, t, f, op)  QCMPJZ(x, t, f, op, &sp[-2].v, &sp[-1].v, 2, 3)
+#define QCMPJZL(x, t, f, op)  QCMPJZ(x, t, f, op, &sp[-1].v, &fp[ip[3]].v, 1, 4)
+
+L(IADD):    QARITHS(ADD, TYPE_INT,   i, +); BREAK;
+L(FADD):    QARITHS(ADD, TYPE_FLOAT, f, +); BREAK;
+L(ISUB):    QARITHS(SUB, TYPE_INT,   i, -); BREAK;
+L(FSUB):    QARITHS(SUB, TYPE_FLOAT, f, -); BREAK;
+L(IMUL):    QARITHS(MUL, TYPE_INT,   i, *); BREAK;
+L(FMUL):    QARITHS(MUL, TYPE_FLOAT, f, *); BREAK;
+
+L(IEQ):     QCMP(EQ, TYPE_INT,   i, TYPE_INT,   i, ==); BREAK;
+L(FEQ):     QCMP(EQ, TYPE_FLOAT, f, TYPE_FLOAT, f, ==); BREAK;
+L(INE):     QCMP(NE, TYPE_INT,   i, TYPE_INT,   i, !=); BREAK;
+L(FNE):     QCMP(NE, TYPE_FLOAT, f, TYPE_FLOAT, f, !=); BREAK;
+L(IGT):     QCMP(GT, TYPE_INT,   i, TYPE_INT,   i, >);  BREAK;
+L(FGT):     QCMP(GT, TYPE_FLOAT, f, TYPE_INT,   i, >);  BREAK;
+L(IGE):     QCMP(GE, TYPE_INT,   i, TYPE_INT,   i, >=); BREAK;
+L(FGE):     QCMP(GE, TYPE_FLOAT, f, TYPE_INT,   i, >=); BREAK;
+L(ILT):     QCMP(LT, TYPE_INT,   i, TYPE_INT,   i, <);  BREAK;
+L(FLT):     QCMP(LT, TYPE_FLOAT, f, TYPE_INT,   i, <);  BREAK;
+L(ILE):     QCMP(LE, TYPE_INT,   i, TYPE_INT,   i, <=); BREAK;
+L(FLE):     QCMP(LE, TYPE_FLOAT, f, TYPE_INT,   i, <=); BREAK;
+
+L(IEQJZ):   QCMPJZS(EQJZ, TYPE_INT,   i, ==); BREAK;
+L(FEQJZ):   QCMPJZS(EQJZ, TYPE_FLOAT, f, ==); BREAK;
+L(INEJZ):   QCMPJZS(NEJZ, TYPE_INT,   i, !=); BREAK;
+L(FNEJZ):   QCMPJZS(NEJZ, TYPE_FLOAT, f, !=); BREAK;
+L(IGTJZ):   QCMPJZS(GTJZ, TYPE_INT,   i, >);  BREAK;
+L(FGTJZ):   QCMPJZS(GTJZ, TYPE_FLOAT, f, >);  BREAK;
+L(IGEJZ):   QCMPJZS(GEJZ, TYPE_INT,   i, >=); BREAK;
+L(FGEJZ):   QCMPJZS(GEJZ, TYPE_FLOAT, f, >=); BREAK;
+L(ILTJZ):   QCMPJZS(LTJZ, TYPE_INT,   i, <);  BREAK;
+L(FLTJZ):   QCMPJZS(LTJZ, TYPE_FLOAT, f, <);  BREAK;
+L(ILEJZ):   QCMPJZS(LEJZ, TYPE_INT,   i, <=); BREAK;
+L(FLEJZ):   QCMPJZS(LEJZ, TYPE_FLOAT, f, <=); BREAK;
+
+L(IADDL):   QARITHL(ADDL, TYPE_INT,   i, +); BREAK;
+L(FADDL):   QARITHL(ADDL, TYPE_FLOAT, f, +); BREAK;
+L(ISUBL):   QARITHL(SUBL, TYPE_INT,   i, -); BREAK;
+L(FSUBL):   QARITHL(SUBL, TYPE_FLOAT, f, -); BREAK;
+L(IMULL):   QARITHL(MULL, TYPE_INT,   i, *); BREAK;
+L(FMULL):   QARITHL(MULL, TYPE_FLOAT, f, *); BREAK;
+
+L(IEQLJZ):  QCMPJZL(EQLJZ, TYPE_INT,   i, ==); BREAK;
+L(FEQLJZ):  QCMPJZL(EQLJZ, TYPE_FLOAT, f, ==); BREAK;
+L(INELJZ):  QCMPJZL(NELJZ, TYPE_INT,   i, !=); BREAK;
+L(FNELJZ):  QCMPJZL(NELJZ, TYPE_FLOAT, f, !=); BREAK;
+L(IGTLJZ):  QCMPJZL(GTLJZ, TYPE_INT,   i, >);  BREAK;
+L(FGTLJZ):  QCMPJZL(GTLJZ, TYPE_FLOAT, f, >);  BREAK;
+L(IGELJZ):  QCMPJZL(GELJZ, TYPE_INT,   i, >=); BREAK;
+L(FGELJZ):  QCMPJZL(GELJZ, TYPE_FLOAT, f, >=); BREAK;
+L(ILTLJZ):  QCMPJZL(LTLJZ, TYPE_INT,   i, <);  BREAK;
+L(FLTLJZ):  QCMPJZL(LTLJZ, TYPE_FLOAT, f, <);  BREAK;
+L(ILELJZ):  QCMPJZL(LELJZ, TYPE_INT,   i, <=); BREAK;
+L(FLELJZ):  QCMPJZL(LELJZ, TYPE_FLOAT, f, <=); BREAK;
+
 #ifndef COMPUTED_GOTO
     }}
 #endif
@@ -5,9 +5,20 @@
 #include "table.h"
 #include "value.h"
 
+// Tags for VM stack elements holding addresses. The tag overlaps the type
+// field of riff_val, letting the collector tell values and addresses apart
+// when scanning the stack.
+enum vm_stack_tags {
+    VM_ADDR = 0xfe, // Address of a local or global variable
+    VM_ELEM = 0xff, // Address of a table element
+};
+
 // VM stack element
 typedef union {
-    riff_val  *a;
+    struct {
+        uint8_t    t;
+        riff_val  *a;
+    };
     riff_val   v;
 } vm_stack;
 
@@ -39,12 +50,17 @@ struct vm_iter {
             riff_int   itvl;
             riff_int   st;   // Start (for ranges)
         };
-        const char *str;
+        struct {
+            size_t      off; // Offset of the next byte
+            riff_str   *s;   // String being iterated over
+        };
     };
     vm_iter   *p;    // Previous loop iterator
 };
 
-int riff_exec(riff_state *);
-int riff_exec_reenter(riff_state *, vm_stack *);
+void riff_vm_mark_roots(void);
+void riff_vm_rebase(riff_val *, size_t, riff_val *);
+int  riff_exec(riff_state *);
+int  riff_exec_reenter(riff_state *, vm_stack *);
 
 #endif
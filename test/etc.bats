@@ -6,9 +6,39 @@ load conf.bash
 
     $RUNFILE test/aoc2020151.rf
     [ "$output" = "1373" ]
+
+    $RUNFILE test/htab.rf
+    [ "$output" = "20000 4000 6750 -2 19999" ]
+
+    $RUNFILE test/relocate.rf
+    [ "$output" = "99 1001 99 501 106 99 99 99" ]
+
+    # Table resized deep in a call chain while an element address is held
+    $RUNCODE 'fn grow() { for i in 1..5000 t[i] = i return 7 } fn f(n) { if n == 0 return grow() return f(n-1) + 0 } t = {} t[0] = f(500) a = t[0] t = {} t[0] = grow() print(a, t[0], #t)'
+    [ "$output" = "7 7 5001" ]
 }
 
 @test "Ad hoc tests (tailcalls)" {
     $RUNFILE test/eea.rf
     [ "$output" = "71" ]
 }
+
+@test "Ad hoc tests (garbage collection)" {
+    $RUNFILE test/gc.rf
+    [ "$output" = "952000" ]
+
+    # Tables dropped while one of their elements is being assigned to
+    $RUNCODE 'fn f() { t = null for i in 1..300000 { x = {i} } return 5 } t = {} t[1] = f() t = {} t.k = f() t = {} t[1][2] = f() print(t == null)'
+    [ "$output" = "1" ]
+}
+
+@test "Ad hoc tests (JIT)" {
+    run $RIFFBIN -j test/eea.rf
+    [ "$output" = "71" ]
+
+    run $RIFFBIN -j test/gc.rf
+    [ "$output" = "952000" ]
+
+    run $RIFFBIN -j -e 'fn f(n) { local s = 0, i = 0 while i < n { s = s + (i & 7) if i == 1500 s = s # "" i++ } return s } local t = 0 for k in 1..3000 { t += k > 1000 } print(f(1000), f(3000), t)'
+    [ "$output" = "3500 10500 2000" ]
+}
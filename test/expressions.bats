@@ -109,6 +109,35 @@ load conf.bash
 
     $RUNCODE 'print("hello"!="hello")'
     [ "$output" -eq 0 ]
+
+    $RUNCODE 'print("hel"#"lo"=="hello")'
+    [ "$output" -eq 1 ]
+
+    $RUNCODE 'print("hello"!="hel"#"lo")'
+    [ "$output" -eq 0 ]
+
+    $RUNCODE 't["hel"#"lo"]=1 print(t.hello)'
+    [ "$output" -eq 1 ]
+}
+
+@test "Compound concatenation" {
+    $RUNCODE 's="" for i in 1..5 { s#=i } print(s)'
+    [ "$output" -eq 12345 ]
+
+    $RUNCODE 's="ab" t=s s#="cd" print(t, s)'
+    [ "$output" = "ab abcd" ]
+
+    $RUNCODE 's="a" s#="b" t=s s#="c" t#="d" print(s, t)'
+    [ "$output" = "abc abd" ]
+
+    $RUNCODE 's=1 s#=2 t=s s#=3 print(t+1, s==123)'
+    [ "$output" = "13 1" ]
+
+    $RUNCODE 's="ab" s#="c" t=s s#="d" print(byte(t, 3), byte(t, 2), byte(s, 3))'
+    [ "$output" = "0 99 100" ]
+
+    $RUNCODE 's="ab" s#="c" t=s s#="d" s=null r="" for c in t { x=t+0 for i in 1..20000 { u="x"#i } r#=c } print(r)'
+    [ "$output" = "abc" ]
 }
 
 @test "Relational ops w/ mismatched types" {
@@ -187,3 +216,99 @@ load conf.bash
     $RUNCODE 'print(a=7+(c=1))'
     [ "$output" -eq 8 ]
 }
+
+@test "Global variables shared across eval()" {
+    $RUNCODE 'x=1 eval("x=5 fn f(){return x*2}") print(x, f())'
+    [ "$output" = "5 10" ]
+
+    $RUNCODE 'fn g(){return y} a=g() eval("y=3") print(a==null, g())'
+    [ "$output" = "1 3" ]
+}
+
+@test "Constant folding" {
+    $RUNCODE 'print(1+2*3, 2**3**2, -2**4, 7/2, "a" # 1+2 # "b", "x#{1}y")'
+    [ "$output" = "7 512 -16 3.5 a3b x1y" ]
+
+    $RUNCODE 'print(-0.0, 0.0, !"0", #"abc", ~0, "1.0"==1, 1<<4|1)'
+    [ "$output" = "-0 0 1 3 -1 1 17" ]
+
+    $RUNCODE 'x=1 print((x ? 2 : 3) + 4, 4 + (x ? 2 : 3))'
+    [ "$output" = "6 6" ]
+
+    # Folded operands don't take up slots in the constants pool
+    $RUNCODE 's = "" for i in 0..99 { s #= "x = " # i # ".5 + " # i # ".25 " } eval(s # "print(x)")'
+    [ "$output" = "198.75" ]
+
+    $RUNCODE 's = "" for i in 0..199 { s #= "x = \"s" # i # "\" # \"t\" " } eval(s # "print(x)")'
+    [ "$output" = "s199t" ]
+
+    $RUNCODE 's = "" for i in 1..300 { s #= "x = " # i # ".5 - " # i # ".25 y = #\"s" # i # "\" # \"t\" if \"k" # i # "\" z = 1 " } eval(s # "print(x, y, z)")'
+    [ "$output" = "0.25 4t 1" ]
+}
+
+@test "Constant conditions" {
+    $RUNCODE 'if 0 print(1) elif "" print(2) else if 1 print(3) else print(4)'
+    [ "$output" -eq 3 ]
+
+    $RUNCODE 'i=0 while 1 { if ++i > 3 break } until 1 { i = 0 } print(i)'
+    [ "$output" -eq 4 ]
+
+    $RUNCODE 'for x in 1..5 { if 1 { if x > 3 { y = x break } continue } else break; i = 0 } print(y)'
+    [ "$output" -eq 4 ]
+
+    $RUNCODE 'i=0 do { if ++i > 5 break; continue } while 1 do i++ while 0 print(i)'
+    [ "$output" -eq 7 ]
+}
+
+@test "Fused instruction sequences" {
+    $RUNCODE 'local a = 1, b = "2" local c = a + b a += b a++ --b print(c, a, b)'
+    [ "$output" = "3 4 1" ]
+
+    $RUNCODE 'local s = "", i = 0 while i < 3 { s #= i i++ } print(s, i)'
+    [ "$output" = "012 3" ]
+
+    $RUNCODE 'local t = {4,5}, k = 1, u local s = "xyz" print(t[k], s[k], u[k], #u)'
+    [ "$output" = "5 y  0" ]
+
+    $RUNCODE 'x = null x++ y = "1.5" --y print(x, y)'
+    [ "$output" = "1 0.5" ]
+}
+
+@test "Register operands and direct stores" {
+    $RUNCODE 'local a = 3, b = "4", s = "x" print(a - b, a * 2, b / a > 1, a ^ b, a << 2, s # a, s # 7)'
+    [ "$output" = "-1 6 1 7 12 x3 x7" ]
+
+    $RUNCODE 'local a = 2, n = null, f = 1.5 print(n + 1, n < a, f * a, a == "2", f != 1, a >= 3)'
+    [ "$output" = "1 1 3 1 1 0" ]
+
+    $RUNCODE 'local a, b x = a = b = 5 y = x z = (x > 2 ? "big" : "small") print(a, b, x, y, z, b = 6)'
+    [ "$output" = "5 5 5 5 big 6" ]
+
+    $RUNCODE 'local i = 0, j = 1 while i < 10 { if i == 3 j = "a" elif j >= "1" j += i i++ } print(i, j)'
+    [ "$output" = "10 a" ]
+}
+
+@test "Quickened instructions" {
+    $RUNCODE 'fn f(a, b) { local r = "" for i in 1..3 { r #= (a + b) # (a * b) # (a < b) # (a == b) # "," if a <= b { r #= "y" } a = a + b } return r } print(f(1, 2), f(0.5, 1.5), f("1", 2), f(2, 0.5), f(1, 2))'
+    [ "$output" = "3210,y5600,71000, 20.7510,y3.5300,55.2500, 3210,y5600,71000, 2.5100,31.2500,3.51.500, 3210,y5600,71000," ]
+}
+
+@test "Numeric strings" {
+    $RUNCODE 'print("1_000" + 0, "0x1f" + 0, " 42" + 1, "-" * 1, "-.5" * 2, "1e3" + 0, "0.1" + "0.2", "00012" + 0, "3." + 0, "7x" + 0)'
+    [ "$output" = "1000 31 43 0 -1 1000 0.3 12 3 7" ]
+
+    $RUNCODE 'print("12345678901234567890" + 0, "9007199254740993" + 0.0, "1.5e-7" * 1, "2.5e400" * 1, "-0" * 1, int("0b11"), int("1_0"))'
+    [ "$output" = "1.2345678901235e+19 9.007199254741e+15 1.5e-07 inf -0 3 10" ]
+
+    $RUNCODE 'n = 0 for s in ["7", "-0", "2.5", "0x10", "0b11", "1e2", " 3", "x", "0.0", ""] { n = 0 for i in 1..3 { t[s] = i n += s * 2 + (s | 0) + (s == 0) + !s } print(s, n, t[s]) }'
+    [ "$output" = "7 63 3
+-0 6 3
+2.5 21 3
+0x10 144 3
+0b11 9 3
+1e2 603 3
+ 3 27 3
+x 0 3
+0.0 6 3
+ 3 3" ]
+}
@@ -16,3 +16,29 @@ load conf.bash
     $RUNCODE 'printf("%b\n", 1<<63)'
     [ "$output" = "1000000000000000000000000000000000000000000000000000000000000000" ]
 }
+
+@test "Results longer than STR_BUF_SZ" {
+    $RUNCODE 'print(#fmt("%5000d|%s", 1, "x"))'
+    [ "$output" -eq 5002 ]
+
+    $RUNCODE 'printf("%5000s|\n", "x")'
+    [ "${#output}" -eq 5001 ]
+
+    $RUNCODE 's="" for i in 1..1000 { s#="abcdef" } print(#"#{s}#{s}", #gsub(s, /a/, "xyz"))'
+    [ "$output" = "12000 8000" ]
+
+    $RUNCODE 's="" for i in 1..1000 { s#="abcdef" } if s ~ /(.*)/ print(#$1)'
+    [ "$output" -eq 6000 ]
+}
+
+@test "Number to string conversion" {
+    $RUNCODE 'print(0, -7, 1 << 63, ~(1 << 63), 0.1 + 0.2, 1e14, 1e15, 99999999999999.5, 2.5e-5, 1e-300, 1/3, -0.0)'
+    [ "$output" = "0 -7 -9223372036854775808 9223372036854775807 0.3 1e+14 1e+15 1e+14 2.5e-05 1e-300 0.33333333333333 -0" ]
+
+    $RUNCODE 'print(#999999999999999999, #-1000, #(1 << 63), #1234567.0, #0.5) x = 12.75 print(x # "", "a" # 1e6, split(0.125, "")[3])'
+    [ "$output" = "18 5 20 11 3
+12.75 a1000000 2" ]
+
+    $RUNCODE 'printf("%d %i %s %g %.3g %.17g %s|%4d|%-6g|\n", 120, -5, 99, 0.0001, 2.0/3, 0.1, 1.5, 3, 0.25)'
+    [ "$output" = "120 -5 99 0.0001 0.667 0.10000000000000001 1.5|   3|0.25  |" ]
+}
@@ -0,0 +1,109 @@
+load conf.bash
+
+@test "Reading lines and bytes" {
+    run sh -c "printf 'a\nbc\n\nlast' | $RIFFBIN -e 'print(read(0), getc(), #read(), read(2), #read(), #read(), read(), #read(), read(0))'"
+    [ "$output" = "1 97 0 bc 0 0 last 0 0" ]
+
+    run sh -c "printf 'x\0y\nz\n' | $RIFFBIN -e 'l = read() print(#l, read(), #read(\"a\"))'"
+    [ "$output" = "3 z 0" ]
+
+    $RUNCODE 'f = open("test/eea.rf") n = 0 while read(f) != "fn eea(n1, n2) {" n++ print(n, #read(f, "a"), #read(f)) close(f) print(read(f))'
+    [ "$output" = "4 327 0
+0" ]
+}
+
+@test "Lines longer than the read buffer" {
+    run sh -c "$RIFFBIN -e 'printf(\"\n%s\n\", fmt(\"%200000s\", \"\"))' | $RIFFBIN -e 'print(#read(), #read(), #read(\"a\"))'"
+    [ "$output" = "0 200000 0" ]
+
+    run sh -c "$RIFFBIN -e 'printf(\"%s\", fmt(\"%100000s\", \"\"))' | $RIFFBIN -e 'print(#read(\"a\"))'"
+    [ "$output" = "100000" ]
+}
+
+@test "Reading memory-mapped files" {
+    f="${BATS_TMPDIR:-/tmp}/riff-mmap-test"
+    $RIFFBIN -e 'for i in 1..200000 printf("line %d\n", i)' > "$f"
+
+    $RUNCODE "f = open(\"$f\") n = 0 s = 0 while (l = read(f)) { n++ s += l[5..] } print(n, s, read(f, 0))"
+    [ "$output" = "200000 20000100000 0" ]
+
+    $RUNCODE "f = open(\"$f\") print(read(f), getc(f), read(f, 3), #read(f, \"a\"), #read(f, \"a\"))"
+    [ "$output" = "line 1 108 ine 2288884 0" ]
+
+    run sh -c "$RIFFBIN -e 'read() print(read(), #read(\"a\"))' < \"$f\""
+    [ "$output" = "line 2 2288881" ]
+
+    rm -f "$f"
+}
+
+@test "Buffered output" {
+    $RUNCODE 'print(1, 2.5, "a", null) printf("%d%s", 3, "b") putc(10) write(4) write("\n")'
+    [ "$output" = "1 2.5 a 
+3b
+4" ]
+
+    run sh -c "$RIFFBIN -e 'print(\"x\\0y\") printf(\"%c\", 0)' | wc -c"
+    [ "$output" -eq 5 ]
+
+    $RUNCODE 'printf("%s", fmt("%100000s", "")) exit(2)'
+    [ "$status" -eq 2 ]
+    [ "${#output}" -eq 100000 ]
+
+    $RUNCODE 'print("a") flush() write("b\n", stderr) print("c")'
+    [ "$output" = "a
+b
+c" ]
+
+    run $RIFFBIN -u -e 'print("a") write("b", stderr) print("c")'
+    [ "$output" = "a
+bc" ]
+
+    # Non-numeric values formatted near the end of the buffer
+    $RUNCODE 'M = 1 << 63 printf("%s", fmt("%65471s", "")) x = M..M:M write(x)'
+    [ "${#output}" -eq 65541 ]
+    [ "${output: -21}" = ":-9223372036854775808" ]
+}
+
+@test "Record processing" {
+    f=$(mktemp)
+    printf 'a b  c\n\n  x\td\n' > "$f"
+
+    run $RIFFBIN -n -e 'print(nr, nf, $1, $3)' "$f"
+    [ "$output" = "1 3 a c
+2 0  
+3 2 x " ]
+
+    printf 'k1,v1\nk2,v2\n' > "$f"
+    run $RIFFBIN -F, -e 'fn BEGIN() { s = "" } s #= $2 fn END() { print(s, nr) }' "$f"
+    [ "$output" = "v1v2 2" ]
+
+    run $RIFFBIN -F '[,2]' -e 'print(nf, $2)' "$f"
+    [ "$output" = "2 v1
+4 " ]
+
+    run sh -c "printf 'l1\n' | $RIFFBIN -n -e 'print(nr, \$0)' \"$f\" -"
+    [ "$output" = "1 k1,v1
+2 k2,v2
+3 l1" ]
+
+    run sh -c "printf 'x y\n' | $RIFFBIN -p -e '\$0 = \$2 # \$1'"
+    [ "$output" = "yx" ]
+
+    run sh -c "printf 'a b c\nd e\n' | $RIFFBIN -n -e 'if nr == 1 { \$9 = \"x\" \$\"4\" = \"y\" } print(nr, nf, \$9, \$4, \$2)'"
+    [ "$output" = "1 3 x y b
+2 2   e" ]
+
+    # Default separator matches split()'s \s+, including CR
+    run sh -c "printf 'a b\r\nc\fd\n' | $RIFFBIN -n -e 'print(nf, #\$2, #split(\$0))'"
+    [ "$output" = "2 1 2
+2 1 2" ]
+
+    # Program read from stdin; no records are left to process
+    run sh -c "echo 'fn END() { print(\"end\", nr) } print(nr)' | $RIFFBIN -n"
+    [ "$status" -eq 0 ]
+    [ "$output" = "end 0" ]
+
+    rm -f "$f"
+    run $RIFFBIN -n -e 'print(1)' "$f"
+    [ "$status" -eq 1 ]
+}
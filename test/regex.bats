@@ -0,0 +1,70 @@
+load conf.bash
+
+@test "Regex literals in loops" {
+    $RUNCODE 'n = 0 for i in 1..100 { if "k" # i ~ /^k(\d*7)$/ n += $1 } print(n)'
+    [ "$output" -eq 520 ]
+
+    $RUNCODE 'for i in 1..3 { printf("%s ", gsub("a-b-c", /-/, i)) t = split("x  y z", / +/) print(#t, t[1]) }'
+    [ "$output" = "a1b1c 3 y
+a2b2c 3 y
+a3b3c 3 y" ]
+
+    $RUNCODE 'print("é" ~ /(*UTF)^.$/, "ab" ~ /^.$/)'
+    [ "$output" = "1 0" ]
+}
+
+@test "Deeply backtracking patterns" {
+    $RUNCODE 's = "" for i in 1..100000 { s #= "ab" } s #= "c" print(s ~ /^(a|b)*c$/, #$0, #gsub(s, /^(a|b)*c$/, "x"), #split(s # " x", /(a|b)*c/))'
+    [ "$output" = "1 200001 1 1" ]
+}
+
+@test "Captures across patterns of different sizes" {
+    $RUNCODE 'if "ab" ~ /a/ if "xyz" ~ /(x)(y)(z)/ if "q" ~ /(q)/ print($0, $1, $2, $3)'
+    [ "$output" = "q q y z" ]
+
+    $RUNCODE 'print(sub("abc", /(b)/, "[$1]"), "abc" ~ /(a)(b)(c)(d)?/, $3, gsub("a1b22", /(\d)+/, "<$1>"), $1)'
+    [ "$output" = "a[b]c 1 c a<1>b<2> 1" ]
+}
+
+@test "String patterns" {
+    $RUNCODE 'n = 0 for i in 1..200 { p = "^" # (i % 40) # "$" for j in 1..40 n += j ~ p } print(n)'
+    [ "$output" -eq 195 ]
+
+    $RUNCODE 'p = "[0-9]" n = 0 for i in 1..50 { n += #gsub(i, p, "") + #split(i # " x") + #split(i, i % 10) } print(n)'
+    [ "$output" -eq 137 ]
+
+    $RUNCODE 't = split("abc", "x*") print(#t, t[0], t[2])'
+    [ "$output" = "3 a c" ]
+
+    $RUNCODE 'sub("abc", "(", "x")'
+    [ "$status" -eq 1 ]
+
+    $RUNCODE 'split("abc", "(")'
+    [ "$status" -eq 1 ]
+}
+
+@test "Captures stored on access" {
+    $RUNCODE 'if "ab" ~ /(a)(b)/ if "x" ~ /(x)/ print($0, $1, $2)'
+    [ "$output" = "x x b" ]
+
+    $RUNCODE 'if "ab" ~ /(a)(b)/ { $1 = "z" print($0, $1, $2) if "ab" ~ /(a)/ print($1, $2) }'
+    [ "$output" = "ab z b
+a b" ]
+
+    $RUNCODE 's = "ab" s ~ /(b)/ s #= "cd" s ~ /nomatch/ print($1, 123 ~ /(2)/, $1, sub("abc", /b(c)/, "x"), $1, $0)'
+    [ "$output" = "b 1 2 ax c bc" ]
+
+    $RUNCODE 'print("foobar" ~ /foo\Kbar/, $0, "ab" ~ /(a)(x)?(b)/, $1, $0)'
+    [ "$output" = "1 bar 1 a ab" ]
+}
+
+@test "Literal patterns" {
+    $RUNCODE 'for s in {"GET /a", "xGET /a", "ERROR: a.b"} { printf("%d%d%d%d %s|", s ~ /^GET /, s ~ /ERROR/, s ~ /a\.b/, s ~ "a.b", $0) } print()'
+    [ "$output" = "1000 GET |0000 GET |0111 a.b|" ]
+
+    $RUNCODE 'n = 0 for s in {"a1 ERROR: x failed", "ERROR: y", "failed"} { if s ~ /(\d) ERROR: (.*) failed/ n += $1 } print(n, gsub("a-b-c", /-b/, "+"), sub("abc", /x+yz/, ""))'
+    [ "$output" = "1 a+-c abc" ]
+
+    $RUNCODE 'print("ac" ~ /ab?c/, "xaay" ~ /a{2}/, "AbC" ~ /(?i)abc/, "a|b" ~ /\Qa|b\E/, "bar" ~ /foo|bar/)'
+    [ "$output" = "1 1 1 1 1" ]
+}